@@ -41,6 +41,16 @@ script_version = "2.1.7"
 
 include("karaskel.lua")
 
+-- Template code and expressions are evaluated for every line and syllable, so
+-- compile each distinct chunk only once when the cache is available
+local cached_loadstring = aegisub.cached_loadstring or function(code, chunkname, env)
+	local f, err = loadstring(code, chunkname)
+	if f and env then
+		setfenv(f, env)
+	end
+	return f, err
+end
+
 
 -- Find and parse/prepare all karaoke template lines
 function parse_templates(meta, styles, subs)
@@ -288,9 +298,8 @@ function template_loop(tenv, initmaxj)
 end
 
 
--- Apply the templates
-function apply_templates(meta, styles, subs, templates)
-	-- the environment the templates will run in
+-- Create the environment the templates will run in
+function create_tenv(meta, styles)
 	local tenv = {
 		meta = meta,
 		-- put in some standard libs
@@ -417,11 +426,21 @@ function apply_templates(meta, styles, subs, templates)
 		return value
 	end
 
-	-- run all run-once code snippets
+	return tenv
+end
+
+-- Run all run-once code snippets
+function run_once_templates(templates, tenv)
 	for k, t in pairs(templates.once) do
 		assert(t.code, "WTF, a 'once' template without code?")
 		run_code_template(t, tenv)
 	end
+end
+
+-- Apply the templates
+function apply_templates(meta, styles, subs, templates)
+	local tenv = create_tenv(meta, styles)
+	run_once_templates(templates, tenv)
 
 	-- start processing lines
 	local i, n = 0, #subs
@@ -443,6 +462,69 @@ function apply_templates(meta, styles, subs, templates)
 	end
 end
 
+-- Copy of the fields of a line which are written back to the file, so that
+-- parallel_map doesn't have to copy the karaoke data between states
+function plain_line(line)
+	return {
+		class = line.class, comment = line.comment, layer = line.layer,
+		start_time = line.start_time, end_time = line.end_time,
+		style = line.style, actor = line.actor,
+		margin_l = line.margin_l, margin_r = line.margin_r,
+		margin_t = line.margin_t, margin_b = line.margin_b,
+		effect = line.effect, text = line.text, extra = line.extra
+	}
+end
+
+-- Worker side of apply_templates_parallel: apply the templates to one line
+-- and return the lines generated from it. Each copy of the script sets up its
+-- own template environment the first time it is handed a new set of
+-- templates, and keeps it for the rest of the lines it gets, just like the
+-- sequential version keeps one environment for every line.
+local worker_shared, worker_tenv
+function apply_line_parallel(line, shared)
+	if worker_shared ~= shared then
+		worker_shared = shared
+		worker_tenv = create_tenv(shared.meta, shared.styles)
+		run_once_templates(shared.templates, worker_tenv)
+	end
+
+	local generated = {}
+	local subs = { append = function(l) table.insert(generated, plain_line(l)) end }
+	karaskel.preproc_line(subs, shared.meta, shared.styles, line)
+	local applied = apply_line(shared.meta, shared.styles, subs, line, shared.templates, worker_tenv)
+	return { lines = generated, line = applied and plain_line(line) or nil }
+end
+
+-- Apply the templates, spreading the lines over the copies of the script
+-- made by aegisub.parallel_map. The generated lines are added in the same
+-- order as apply_templates adds them.
+function apply_templates_parallel(meta, styles, subs, templates)
+	local jobs = {}
+	for i = 1, #subs do
+		local l = subs[i]
+		if l.class == "dialogue" and ((l.effect == "" and not l.comment) or l.effect:match("[Kk]araoke")) then
+			l.i = i
+			l.comment = false
+			table.insert(jobs, l)
+		end
+	end
+
+	local results = aegisub.parallel_map(apply_line_parallel, jobs, {meta = meta, styles = styles, templates = templates})
+
+	for j, l in ipairs(jobs) do
+		local res = results[j]
+		for _, newline in ipairs(res.lines) do
+			subs.append(newline)
+		end
+		if res.line then
+			-- Some templates were applied to this line, make a karaoke timing line of it
+			res.line.comment = true
+			res.line.effect = "karaoke"
+			subs[l.i] = res.line
+		end
+	end
+end
+
 function set_ctx_syl(varctx, line, syl)
 	varctx.sstart = syl.start_time
 	varctx.send = syl.end_time
@@ -632,13 +714,12 @@ function apply_line(meta, styles, subs, line, templates, tenv)
 end
 
 function run_code_template(template, tenv)
-	local f, err = loadstring(template.code, "template code")
+	local f, err = cached_loadstring(template.code, "template code", tenv)
 	if not f then
 		aegisub.debug.out(2, "Failed to parse Lua code: %s\nCode that failed to parse: %s\n\n", err, template.code)
 		aegisub.cancel()
 	else
 		local pcall = pcall
-		setfenv(f, tenv)
 		for j, maxj in template_loop(tenv, template.loops) do
 			local res, err = pcall(f)
 			if not res then
@@ -674,12 +755,11 @@ function run_text_template(template, tenv, varctx)
 
 	-- Function for evaluating expressions
 	local function expression_evaluator(expression)
-		f, err = loadstring(string.format("return (%s)", expression))
+		local f, err = cached_loadstring("return (" .. expression .. ")", nil, tenv)
 		if (err) ~= nil then
 			aegisub.debug.out(2, "Error parsing expression: %s\nExpression producing error: %s\nTemplate with expression: %s\n\n", err, expression, template)
 			aegisub.cancel()
 		else
-			setfenv(f, tenv)
 			local res, val = pcall(f)
 			if res then
 				return val
@@ -829,7 +909,11 @@ function filter_apply_templates(subs, config)
 	local templates = parse_templates(meta, styles, subs)
 
 	aegisub.progress.task("Applying templates...")
-	apply_templates(meta, styles, subs, templates)
+	if config and config.parallel then
+		apply_templates_parallel(meta, styles, subs, templates)
+	else
+		apply_templates(meta, styles, subs, templates)
+	end
 end
 
 function macro_apply_templates(subs, sel)
@@ -837,6 +921,11 @@ function macro_apply_templates(subs, sel)
 	aegisub.set_undo_point("apply karaoke template")
 end
 
+function macro_apply_templates_parallel(subs, sel)
+	filter_apply_templates(subs, {ismacro=true, sel=sel, parallel=true})
+	aegisub.set_undo_point("apply karaoke template")
+end
+
 function macro_can_template(subs)
 	-- check if this file has templates in it, don't allow running the macro if it hasn't
 	local num_dia = 0
@@ -858,4 +947,7 @@ function macro_can_template(subs)
 end
 
 aegisub.register_macro(tr"Apply karaoke template", tr"Applies karaoke effects from templates", macro_apply_templates, macro_can_template)
+if aegisub.parallel_map then
+	aegisub.register_macro(tr"Apply karaoke template (parallel)", tr"Applies karaoke effects from templates on several threads. Template code must not rely on global variables set while processing earlier lines.", macro_apply_templates_parallel, macro_can_template)
+end
 aegisub.register_filter(tr"Karaoke template", tr"Apply karaoke effect templates to the subtitles.\n\nSee the help file for information on how to use this.", 2000, filter_apply_templates)
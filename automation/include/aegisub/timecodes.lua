@@ -0,0 +1,36 @@
+-- Copyright (c) 2026, Aegisub contributors
+--
+-- Permission to use, copy, modify, and distribute this software for any
+-- purpose with or without fee is hereby granted, provided that the above
+-- copyright notice and this permission notice appear in all copies.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+-- WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+-- MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+-- ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+-- WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+-- ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+-- OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+-- Frame/time conversion of FFI int32 arrays, for scripts which keep their
+-- times in FFI buffers rather than Lua tables
+
+local ffi = require 'ffi'
+local impl, current_timecodes = aegisub.__init_timecodes()
+
+local types = {exact = 0, start = 1, ['end'] = 2}
+
+local function wrap(convert)
+  return function(input, count, output, time_type)
+    local t = types[time_type or 'start']
+    if not t then error("unknown time type '" .. tostring(time_type) .. "'", 2) end
+    local fps = current_timecodes()
+    if fps == nil then return false end
+    return convert(fps, input, count, output or ffi.cast('int *', input), t) ~= 0
+  end
+end
+
+return {
+  frames_from_ms = wrap(impl.frames_from_ms),
+  ms_from_frames = wrap(impl.ms_from_frames)
+}
@@ -35,6 +35,10 @@ if not karaskel then
 	karaskel = {}
 end
 
+-- Native implementation of preproc_line_pos for lines which haven't been
+-- preprocessed yet. Set this to nil to always use the Lua implementation.
+karaskel.native_preproc = aegisub.karaskel_preproc
+
 -- Collect styles and metadata from the subs
 function karaskel.collect_head(subs, generate_furigana)
 	local meta = {
@@ -272,14 +276,24 @@ function karaskel.preproc_line_size(meta, styles, line)
 	line.width, line.height, line.descent, line.extlead = aegisub.text_extents(line.styleref, line.text_stripped)
 	line.width = line.width * meta.video_x_correct_factor
 
-	-- Calculate syllable sizing
+	-- Calculate syllable sizing, measuring every piece of every syllable
+	-- in one call
+	local texts = {}
+	for s = 0, line.kara.n do
+		local syl = line.kara[s]
+		texts[#texts+1] = syl.text_spacestripped
+		texts[#texts+1] = syl.prespace
+		texts[#texts+1] = syl.postspace
+	end
+	local widths, heights = aegisub.text_extents_many(line.styleref, texts)
 	for s = 0, line.kara.n do
 		local syl = line.kara[s]
+		local i = s * 3 + 1
 		syl.style = line.styleref
-		syl.width, syl.height = aegisub.text_extents(syl.style, syl.text_spacestripped)
+		syl.width, syl.height = widths[i], heights[i]
 		syl.width = syl.width * meta.video_x_correct_factor
-		syl.prespacewidth = aegisub.text_extents(syl.style, syl.prespace) * meta.video_x_correct_factor
-		syl.postspacewidth = aegisub.text_extents(syl.style, syl.postspace) * meta.video_x_correct_factor
+		syl.prespacewidth = widths[i+1] * meta.video_x_correct_factor
+		syl.postspacewidth = widths[i+2] * meta.video_x_correct_factor
 	end
 	
 	-- Calculate furigana sizing
@@ -302,10 +316,30 @@ function karaskel.preproc_line_size(meta, styles, line)
 end
 
 
+-- The Lua implementations of the steps native_preproc replicates; it is
+-- skipped if a script has replaced any of them
+local builtin_steps = {}
+
+local function use_native_preproc(line)
+	if line.kara or not karaskel.native_preproc then
+		return false
+	end
+	for name, func in pairs(builtin_steps) do
+		if karaskel[name] ~= func then
+			return false
+		end
+	end
+	return true
+end
+
+
 -- Layout a line, including furigana layout
 -- Modifies the object passed for line
 function karaskel.preproc_line_pos(meta, styles, line)
 	if not line.styleref then
+		if use_native_preproc(line) then
+			return karaskel.native_preproc(meta, styles, line)
+		end
 		karaskel.preproc_line_size(meta, styles, line)
 	end
 	
@@ -529,6 +563,11 @@ function karaskel.do_furigana_layout(meta, styles, line)
 end
 
 
+for _, name in ipairs({"preproc_line_text", "preproc_line_size", "do_basic_layout", "do_furigana_layout"}) do
+	builtin_steps[name] = karaskel[name]
+end
+
+
 -- Precalc some info on a line
 -- Modifies the line parameter
 function karaskel.preproc_line(subs, meta, styles, line)
@@ -0,0 +1,80 @@
+﻿script_name = "Test native karaskel preprocessing"
+script_description = "Checks that aegisub.karaskel_preproc produces the same lines as the Lua karaskel code and compares their speed"
+script_author = "Aegisub contributors"
+
+include "karaskel.lua"
+
+-- Compare two values, with tables compared by content. seen maps each table
+-- from a to the table it was matched with in b (and the reverse), so shared
+-- tables such as syl.line and furi.highlights must also be shared the same way
+local function compare(a, b, seen, path)
+	if type(a) ~= "table" or type(b) ~= "table" then
+		if a == b then return true end
+		return false, string.format("%s: lua=%s native=%s", path, tostring(a), tostring(b))
+	end
+	if seen[a] or seen[b] then
+		if seen[a] == b and seen[b] == a then return true end
+		return false, path .. ": tables are shared differently"
+	end
+	seen[a], seen[b] = b, a
+	for k, v in pairs(a) do
+		local ok, err = compare(v, b[k], seen, path .. "." .. tostring(k))
+		if not ok then return false, err end
+	end
+	for k in pairs(b) do
+		if a[k] == nil then
+			return false, path .. "." .. tostring(k) .. ": only set by native"
+		end
+	end
+	return true
+end
+
+local function preproc(meta, styles, line, native)
+	local saved = karaskel.native_preproc
+	if not native then karaskel.native_preproc = nil end
+	karaskel.preproc_line(nil, meta, styles, line)
+	karaskel.native_preproc = saved
+	return line
+end
+
+function test_native_preproc(subs)
+	if not karaskel.native_preproc then
+		aegisub.debug.out(0, "aegisub.karaskel_preproc is not available\n")
+		return
+	end
+
+	local meta, styles = karaskel.collect_head(subs, false)
+	local lines = {}
+	for i = 1, #subs do
+		if subs[i].class == "dialogue" then
+			table.insert(lines, subs[i])
+		end
+	end
+
+	aegisub.progress.task("Comparing results")
+	local failed = 0
+	for _, line in ipairs(lines) do
+		local ok, err = compare(preproc(meta, styles, table.copy(line), false),
+			preproc(meta, styles, table.copy(line), true), {}, "line")
+		if not ok then
+			failed = failed + 1
+			aegisub.debug.out(1, "Mismatch on '%s'\n\t%s\n", line.text, err)
+		end
+	end
+	aegisub.debug.out(failed > 0 and 1 or 3, "%d of %d lines identical\n", #lines - failed, #lines)
+
+	aegisub.progress.task("Benchmarking")
+	local rounds = 200
+	for _, native in ipairs({false, true}) do
+		local start = os.clock()
+		for _ = 1, rounds do
+			for _, line in ipairs(lines) do
+				preproc(meta, styles, table.copy(line), native)
+			end
+		end
+		aegisub.debug.out(3, "%s: %.1f us per line\n", native and "native" or "lua",
+			(os.clock() - start) * 1e6 / (rounds * #lines))
+	end
+end
+
+aegisub.register_macro("Test native karaskel", "Compare native and Lua karaskel preprocessing on every line", test_native_preproc)
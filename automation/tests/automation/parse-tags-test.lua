@@ -0,0 +1,51 @@
+﻿script_name = "Test parse_tags"
+script_description = "Checks that aegisub.unparse_tags writes back what aegisub.parse_tags read, including values which do not survive conversion to their type"
+script_author = "Aegisub contributors"
+
+-- Each case is the input and what unparse_tags should give back for it
+local round_trips = {
+	{"", ""},
+	{"plain text", "plain text"},
+	{"{\\pos(10.5,20)\\fs30}Hi{\\i1}there{comment}x", "{\\pos(10.5,20)\\fs30}Hi{\\i1}there{comment}x"},
+	-- Values which atoi/atof would change
+	{"{\\be1.5\\b1foo\\fs20.50\\bord2.12345}x", "{\\be1.5\\b1foo\\fs20.50\\bord2.12345}x"},
+	{"{\\1a&H8&\\alpha80\\i2}x", "{\\1a&H8&\\alpha80\\i2}x"},
+	{"{\\t(0,100,\\fs020\\1a&H80&)\\junk}x", "{\\t(0,100,\\fs020\\1a&H80&)\\junk}x"},
+	{"{\\clip(1,2,3,4)\\iclip(2,m 0 0 l 10 10)}x{\\p1}m 0 0 l 1 1{\\p0}y", "{\\clip(1,2,3,4)\\iclip(2,m 0 0 l 10 10)}x{\\p1}m 0 0 l 1 1{\\p0}y"},
+	-- Tags are rebuilt from their parameters, as when Aegisub edits a line
+	{"{\\fad( 100 , 200 )}x", "{\\fad(100,200)}x"},
+}
+
+-- Each case changes one value and gives what unparse_tags should write then
+local edits = {
+	{"{\\be1.5}x", function(b) b[1].tags[1].params[1].value = 2 end, "{\\be2}x"},
+	{"{\\fs20.50}x", function(b) b[1].tags[1].params[1].value = 21.25 end, "{\\fs21.25}x"},
+	{"{\\1a&H8&}x", function(b) b[1].tags[1].params[1].value = 16 end, "{\\1a&H10&}x"},
+	{"{\\i1}x", function(b) b[1].tags[1].params[1].value = false end, "{\\i0}x"},
+	{"{\\t(\\fs20)}x", function(b) b[1].tags[1].params[4].value[1].params[1].value = 30 end, "{\\t(\\fs30)}x"},
+	{"{\\fs20}x", function(b) table.insert(b[1].tags, "\\blur2") end, "{\\fs20\\blur2}x"},
+}
+
+function test_parse_tags()
+	local failed, total = 0, 0
+	local function check(input, got, expected)
+		total = total + 1
+		if got ~= expected then
+			failed = failed + 1
+			aegisub.debug.out(1, "Mismatch on '%s'\n\texpected '%s'\n\tgot      '%s'\n", input, expected, got)
+		end
+	end
+
+	for _, case in ipairs(round_trips) do
+		check(case[1], aegisub.unparse_tags(aegisub.parse_tags(case[1])), case[2])
+	end
+	for _, case in ipairs(edits) do
+		local blocks = aegisub.parse_tags(case[1])
+		case[2](blocks)
+		check(case[1], aegisub.unparse_tags(blocks), case[3])
+	end
+
+	aegisub.debug.out(failed > 0 and 1 or 3, "%d of %d cases passed\n", total - failed, total)
+end
+
+aegisub.register_macro("Test parse_tags", "Check that override tags survive aegisub.parse_tags and aegisub.unparse_tags", test_parse_tags)
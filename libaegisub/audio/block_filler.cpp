@@ -0,0 +1,121 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#include "block_filler.h"
+
+#include "libaegisub/audio/provider.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace agi {
+AudioBlockFiller::AudioBlockFiller(AudioProvider const& source, int64_t block_size,
+	std::atomic<int64_t>& decoded_samples, FillFunc fill, bool concurrent_fill)
+: block_size(block_size)
+, num_samples(source.GetNumSamples())
+, num_blocks(static_cast<size_t>((num_samples + block_size - 1) / block_size))
+, decoded_samples(decoded_samples)
+, fill(std::move(fill))
+, claimed(num_blocks, false)
+, done(num_blocks, false)
+, wanted_block(num_blocks)
+{
+	decoded_samples = 0;
+
+	size_t threads = 1;
+	if (concurrent_fill && source.SupportsConcurrentReads())
+		threads = std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+	threads = std::min(threads, num_blocks);
+
+	for (size_t i = 0; i < threads; ++i)
+		workers.emplace_back([=] { Work(); });
+}
+
+AudioBlockFiller::~AudioBlockFiller() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+	}
+	block_done.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void AudioBlockFiller::Work() {
+	for (;;) {
+		size_t block;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cancelled) return;
+
+			// Blocks readers are blocked on jump the queue
+			if (wanted_block < num_blocks && !claimed[wanted_block])
+				block = wanted_block;
+			else {
+				while (next_block < num_blocks && claimed[next_block])
+					++next_block;
+				if (next_block == num_blocks) return;
+				block = next_block;
+			}
+			claimed[block] = true;
+		}
+
+		int64_t start = block * block_size;
+		fill(block, start, std::min(block_size, num_samples - start));
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done[block] = true;
+
+			size_t contiguous = static_cast<size_t>(decoded_samples / block_size);
+			while (contiguous < num_blocks && done[contiguous])
+				++contiguous;
+			decoded_samples = std::min(num_samples, (int64_t)contiguous * block_size);
+		}
+		block_done.notify_all();
+	}
+}
+
+bool AudioBlockFiller::IsDone(size_t block) const {
+	if ((int64_t)(block + 1) * block_size <= decoded_samples)
+		return true;
+	std::lock_guard<std::mutex> lock(mutex);
+	return block < num_blocks && done[block];
+}
+
+bool AudioBlockFiller::Wait(int64_t start, int64_t count, int timeout_ms) const {
+	if (start + count <= decoded_samples) return true;
+
+	size_t first = static_cast<size_t>(std::max<int64_t>(start, 0) / block_size);
+	size_t last = static_cast<size_t>(std::min(start + count, num_samples) + block_size - 1) / block_size;
+	auto missing = [&] {
+		for (size_t i = first; i < last; ++i) {
+			if (!done[i]) return i;
+		}
+		return last;
+	};
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	std::unique_lock<std::mutex> lock(mutex);
+	for (size_t block; (block = missing()) != last; ) {
+		if (cancelled) return false;
+		wanted_block = block;
+		if (block_done.wait_until(lock, deadline) == std::cv_status::timeout)
+			return missing() == last;
+	}
+	return true;
+}
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace agi {
+class AudioProvider;
+
+/// @class AudioBlockFiller
+/// @brief Background decoder for the cache providers
+///
+/// Splits the audio into fixed-size blocks and decodes them on one or more
+/// worker threads. Sources which support concurrent reads get several
+/// workers decoding disjoint blocks at once, while everything else is read
+/// in order on a single thread as before. Completed blocks are tracked in a
+/// bitmap, and readers waiting on a block which hasn't been decoded yet have
+/// it moved to the front of the queue.
+class AudioBlockFiller {
+public:
+	/// Decode samples [start, start + count) of block into the cache
+	using FillFunc = std::function<void(size_t block, int64_t start, int64_t count)>;
+
+private:
+	int64_t block_size;
+	int64_t num_samples;
+	size_t num_blocks;
+	std::atomic<int64_t>& decoded_samples;
+	FillFunc fill;
+
+	mutable std::mutex mutex;
+	mutable std::condition_variable block_done;
+	std::vector<bool> claimed;
+	std::vector<bool> done;
+	/// Lowest block which hasn't been claimed by a worker
+	size_t next_block = 0;
+	/// Block which a reader is waiting on, or num_blocks if none
+	mutable size_t wanted_block;
+	bool cancelled = false;
+
+	std::vector<std::thread> workers;
+
+	void Work();
+
+public:
+	/// @param source Provider which fill reads from
+	/// @param block_size Samples per block
+	/// @param decoded_samples Counter to update with the number of
+	///                        contiguous samples from the start which are done
+	/// @param fill Function which decodes a block
+	/// @param concurrent_fill Can fill itself be called from several threads
+	///                        at once, if the source allows it?
+	AudioBlockFiller(AudioProvider const& source, int64_t block_size,
+		std::atomic<int64_t>& decoded_samples, FillFunc fill, bool concurrent_fill = true);
+
+	/// Stops the workers, abandoning any blocks which haven't been started
+	~AudioBlockFiller();
+
+	/// Has block been decoded?
+	bool IsDone(size_t block) const;
+
+	/// @brief Wait for all of the blocks overlapping a range of samples
+	/// @param start First sample
+	/// @param count Number of samples
+	/// @param timeout_ms Milliseconds to wait before giving up
+	/// @return Were all of the blocks decoded?
+	bool Wait(int64_t start, int64_t count, int timeout_ms) const;
+};
+}
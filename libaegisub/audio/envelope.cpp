@@ -0,0 +1,220 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#include "libaegisub/audio/envelope.h"
+
+#include "libaegisub/audio/provider.h"
+#include "libaegisub/io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+namespace {
+using namespace agi;
+
+/// Number of samples each worker reads at a time
+const int64_t chunk_size = 1 << 20;
+
+/// How long to wait for a caching provider which has stopped making progress
+/// before giving up on it
+const std::chrono::seconds stall_timeout(30);
+
+const char file_magic[8] = {'A', 'G', 'I', 'E', 'N', 'V', '0', '1'};
+
+template<typename T>
+void write(std::ostream& out, T value) {
+	out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+T read(std::istream& in) {
+	T value;
+	in.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return value;
+}
+}
+
+namespace agi {
+AudioEnvelope::AudioEnvelope(AudioProvider const& provider)
+: num_samples(provider.GetNumSamples())
+, sample_rate(provider.GetSampleRate())
+{
+	if (provider.GetBytesPerSample() != 2 || provider.GetChannels() != 1 || provider.AreSamplesFloat())
+		throw InternalError("AudioEnvelope requires 16-bit mono audio");
+
+	levels.emplace_back((num_samples + block_size - 1) / block_size);
+	auto& blocks = levels[0];
+
+	const int64_t chunks = (num_samples + chunk_size - 1) / chunk_size;
+	std::atomic<int64_t> next_chunk{0};
+	std::exception_ptr error;
+	std::mutex error_lock;
+
+	// Caching providers hand out silence for the parts which they haven't
+	// gotten to yet, so wait for them, but only for as long as the cache
+	// keeps making progress
+	auto wait_for_samples = [&](int64_t end) {
+		int64_t decoded = provider.GetDecodedSamples();
+		auto deadline = std::chrono::steady_clock::now() + stall_timeout;
+		while (decoded < end) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			int64_t now_decoded = provider.GetDecodedSamples();
+			if (now_decoded != decoded) {
+				decoded = now_decoded;
+				deadline = std::chrono::steady_clock::now() + stall_timeout;
+			}
+			else if (std::chrono::steady_clock::now() > deadline)
+				throw AudioEnvelopeError("Timed out waiting for the audio to be decoded");
+		}
+	};
+
+	auto worker = [&] {
+		std::vector<int16_t> buf(chunk_size);
+		for (int64_t chunk; (chunk = next_chunk++) < chunks; ) try {
+			int64_t start = chunk * chunk_size;
+			int64_t count = std::min(chunk_size, num_samples - start);
+
+			wait_for_samples(start + count);
+			provider.GetAudio(buf.data(), start, count);
+
+			for (int64_t i = 0; i < count; i += block_size) {
+				auto begin = buf.data() + i, end = begin + std::min<int64_t>(block_size, count - i);
+				Node node{*begin, *begin, 0.};
+				for (auto p = begin; p != end; ++p) {
+					node.min = std::min(node.min, *p);
+					node.max = std::max(node.max, *p);
+					node.sum_squares += (double)*p * *p;
+				}
+				blocks[(start + i) / block_size] = node;
+			}
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(error_lock);
+			if (!error) error = std::current_exception();
+			next_chunk = chunks;
+		}
+	};
+
+	auto threads = (int64_t)std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+	std::vector<std::thread> pool;
+	for (int64_t i = 1; i < std::min(threads, chunks); ++i)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& thread : pool)
+		thread.join();
+	if (error)
+		std::rethrow_exception(error);
+
+	BuildPyramid();
+}
+
+AudioEnvelope::AudioEnvelope(fs::path const& file, AudioProvider const& provider) {
+	auto in = io::Open(file, true);
+
+	char magic[sizeof file_magic];
+	in->read(magic, sizeof magic);
+	if (!*in || memcmp(magic, file_magic, sizeof magic))
+		throw AudioEnvelopeError("Not an audio envelope file: " + file.string());
+
+	if (read<int32_t>(*in) != block_size)
+		throw AudioEnvelopeError("Audio envelope has the wrong block size");
+	num_samples = read<int64_t>(*in);
+	sample_rate = read<int32_t>(*in);
+	if (!*in || num_samples != provider.GetNumSamples() || sample_rate != provider.GetSampleRate())
+		throw AudioEnvelopeError("Audio envelope does not match the audio");
+
+	levels.emplace_back((num_samples + block_size - 1) / block_size);
+	for (auto& node : levels[0]) {
+		node.min = read<int16_t>(*in);
+		node.max = read<int16_t>(*in);
+		node.sum_squares = read<double>(*in);
+	}
+	if (!*in)
+		throw AudioEnvelopeError("Audio envelope file is truncated: " + file.string());
+
+	BuildPyramid();
+}
+
+void AudioEnvelope::Save(fs::path const& file) const {
+	io::Save save(file, true);
+	auto& out = save.Get();
+	out.write(file_magic, sizeof file_magic);
+	write<int32_t>(out, block_size);
+	write<int64_t>(out, num_samples);
+	write<int32_t>(out, sample_rate);
+	for (auto const& node : levels[0]) {
+		write<int16_t>(out, node.min);
+		write<int16_t>(out, node.max);
+		write<double>(out, node.sum_squares);
+	}
+}
+
+void AudioEnvelope::BuildPyramid() {
+	levels.resize(1);
+	while (levels.back().size() > 1) {
+		auto const& below = levels.back();
+		std::vector<Node> level((below.size() + 1) / 2);
+		for (size_t i = 0; i < level.size(); ++i) {
+			level[i] = below[i * 2];
+			if (i * 2 + 1 < below.size()) {
+				auto const& right = below[i * 2 + 1];
+				level[i].min = std::min(level[i].min, right.min);
+				level[i].max = std::max(level[i].max, right.max);
+				level[i].sum_squares += right.sum_squares;
+			}
+		}
+		levels.push_back(std::move(level));
+	}
+}
+
+AudioEnvelopePoint AudioEnvelope::Summarise(int64_t start, int64_t end) const {
+	AudioEnvelopePoint point;
+	start = std::max<int64_t>(start, 0);
+	end = std::min(end, num_samples);
+	if (start >= end) return point;
+
+	size_t lo = start / block_size;
+	size_t hi = (end + block_size - 1) / block_size;
+	int64_t count = std::min<int64_t>(hi * block_size, num_samples) - (int64_t)lo * block_size;
+
+	// Walk up the pyramid, taking the nodes which stick out of the range
+	// covered by the parents of the rest
+	bool first = true;
+	double sum_squares = 0.;
+	auto add = [&](Node const& node) {
+		point.min = first ? node.min : std::min(point.min, node.min);
+		point.max = first ? node.max : std::max(point.max, node.max);
+		sum_squares += node.sum_squares;
+		first = false;
+	};
+
+	for (size_t level = 0; lo < hi; ++level, lo /= 2, hi /= 2) {
+		if (lo & 1) add(levels[level][lo++]);
+		if (hi & 1) add(levels[level][--hi]);
+	}
+
+	point.rms = std::sqrt(sum_squares / count);
+	return point;
+}
+}
@@ -19,16 +19,177 @@
 #include <libaegisub/log.h>
 #include <libaegisub/make_unique.h>
 
-#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 using namespace agi;
 
-/// Anything integral -> 16 bit signed machine-endian audio converter
 namespace {
-template<class Target>
+/// Size of the stack buffer which converters read source audio into. Reading
+/// in bounded chunks rather than into a per-object buffer keeps FillBuffer
+/// safe to call from several threads at once and keeps the source data in
+/// cache while it's converted.
+const size_t scratch_size = 1 << 15;
+
+/// Read count frames from source starting at start in chunks which fit in
+/// scratch_size bytes, calling fn(src, offset, chunk_count) for each
+template<typename Func>
+void ForEachChunk(AudioProvider const& source, int64_t start, size_t count, Func&& fn) {
+	alignas(16) uint8_t scratch[scratch_size];
+	size_t frame_bytes = source.GetBytesPerSample() * source.GetChannels();
+	size_t chunk = std::max<size_t>(1, scratch_size / frame_bytes);
+	for (size_t offset = 0; offset < count; offset += chunk) {
+		size_t n = std::min(chunk, count - offset);
+		source.GetAudio(scratch, start + offset, n);
+		fn(scratch, offset, n);
+	}
+}
+
+/// 8-bit unsigned with a bias of 128 -> 16-bit signed
+void Convert8(const uint8_t *src, int16_t *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = static_cast<int16_t>((src[i] - 128) * 256);
+}
+
+/// 24-bit little-endian signed -> 16-bit signed, by dropping the low byte
+void Convert24(const uint8_t *src, int16_t *dst, size_t count) {
+	size_t i = 0;
+#ifdef __SSSE3__
+	// Eight samples are 24 bytes, read as two overlapping 16 byte loads:
+	// bytes 0-15 hold samples 0-4 and bytes 8-23 hold samples 5-7
+	const __m128i lo = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, 13, 14, -1, -1, -1, -1, -1, -1);
+	const __m128i hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, 9, 11, 12, 14, 15);
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3 + 8));
+		__m128i out = _mm_or_si128(_mm_shuffle_epi8(a, lo), _mm_shuffle_epi8(b, hi));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = static_cast<int16_t>(src[i * 3 + 1] | src[i * 3 + 2] << 8);
+}
+
+/// 32-bit signed -> 16-bit signed, by dropping the low half
+void Convert32(const uint8_t *src, int16_t *dst, size_t count) {
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4)), 16);
+		__m128i b = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16)), 16);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = static_cast<int16_t>(src[i * 4 + 2] | src[i * 4 + 3] << 8);
+}
+
+/// Any other width of little-endian signed integer -> 16-bit signed
+void ConvertGeneric(const uint8_t *src, int16_t *dst, size_t count, int src_bytes) {
+	for (size_t i = 0; i < count; ++i) {
+		int64_t sample = 0;
+		for (int j = src_bytes; j > 0; --j) {
+			sample <<= 8;
+			sample += src[i * src_bytes + j - 1];
+		}
+
+		if (src_bytes > 2)
+			sample /= 1LL << (src_bytes - 2) * 8;
+		else
+			sample *= 1LL << (2 - src_bytes) * 8;
+
+		dst[i] = static_cast<int16_t>(sample);
+	}
+}
+
+/// Scale a floating point sample in [-1, 1] to 16 bits, clamping anything
+/// outside that range
+template<typename Source>
+int16_t FloatToInt16(Source sample) {
+	Source expanded = sample < 0 ? sample * 32768 : sample * 32767;
+	return expanded <= -32768 ? INT16_MIN :
+	       expanded >= 32767  ? INT16_MAX :
+	                            static_cast<int16_t>(expanded);
+}
+
+void ConvertFloat(const float *src, int16_t *dst, size_t count) {
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 neg_scale = _mm_set1_ps(32768.f);
+	const __m128 pos_scale = _mm_set1_ps(32767.f);
+	const __m128 min = _mm_set1_ps(-32768.f);
+	const __m128 max = _mm_set1_ps(32767.f);
+	auto scale = [&](__m128 x) {
+		__m128 neg = _mm_cmplt_ps(x, zero);
+		__m128 factor = _mm_or_ps(_mm_and_ps(neg, neg_scale), _mm_andnot_ps(neg, pos_scale));
+		return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(x, factor), min), max));
+	};
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = scale(_mm_loadu_ps(src + i));
+		__m128i b = scale(_mm_loadu_ps(src + i + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = FloatToInt16(src[i]);
+}
+
+void ConvertFloat(const double *src, int16_t *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = FloatToInt16(src[i]);
+}
+
+/// Average interleaved stereo down to mono
+void DownmixStereo(const int16_t *src, int16_t *dst, size_t count) {
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128i ones = _mm_set1_epi16(1);
+	auto average = [&](const int16_t *p) {
+		__m128i sum = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), ones);
+		// Round towards zero to match integer division
+		return _mm_srai_epi32(_mm_add_epi32(sum, _mm_srli_epi32(sum, 31)), 1);
+	};
+	for (; i + 8 <= count; i += 8) {
+		__m128i out = _mm_packs_epi32(average(src + i * 2), average(src + i * 2 + 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = static_cast<int16_t>((src[i * 2] + src[i * 2 + 1]) / 2);
+}
+
+/// Average any number of interleaved channels down to mono. Instantiated
+/// with a fixed channel count for common layouts so that the inner loop is
+/// unrolled and the division becomes a multiplication.
+template<int Channels>
+void DownmixFixed(const int16_t *src, int16_t *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		int sum = 0;
+		for (int c = 0; c < Channels; ++c)
+			sum += src[i * Channels + c];
+		dst[i] = static_cast<int16_t>(sum / Channels);
+	}
+}
+
+void DownmixGeneric(const int16_t *src, int16_t *dst, size_t count, int channels) {
+	for (size_t i = 0; i < count; ++i) {
+		int sum = 0;
+		for (int c = 0; c < channels; ++c)
+			sum += src[i * channels + c];
+		dst[i] = static_cast<int16_t>(sum / channels);
+	}
+}
+
+/// Anything integral -> 16 bit signed machine-endian audio converter
 class BitdepthConvertAudioProvider final : public AudioProviderWrapper {
 	int src_bytes_per_sample;
-	mutable std::vector<uint8_t> src_buf;
 
 public:
 	BitdepthConvertAudioProvider(std::unique_ptr<AudioProvider> src) : AudioProviderWrapper(std::move(src)) {
@@ -36,80 +197,60 @@ public:
 			throw AudioProviderError("Audio format converter: audio with bitdepths greater than 64 bits/sample is currently unsupported");
 
 		src_bytes_per_sample = bytes_per_sample;
-		bytes_per_sample = sizeof(Target);
+		bytes_per_sample = sizeof(int16_t);
+	}
+
+	std::string GetDecodeKey() const override {
+		return source->GetDecodeKey() + "/s16";
 	}
 
 	void FillBuffer(void *buf, int64_t start, int64_t count64) const override {
 		auto count = static_cast<size_t>(count64);
 		assert(count == count64);
 
-		src_buf.resize(count * src_bytes_per_sample * channels);
-		source->GetAudio(src_buf.data(), start, count);
-
 		auto dest = static_cast<int16_t*>(buf);
-
-		for (int64_t i = 0; i < count * channels; ++i) {
-			int64_t sample = 0;
-
+		ForEachChunk(*source, start, count, [&](const uint8_t *src, size_t offset, size_t n) {
+			auto out = dest + offset * channels;
+			n *= channels;
 			// 8 bits per sample is assumed to be unsigned with a bias of 127,
 			// while everything else is assumed to be signed with zero bias
-			if (src_bytes_per_sample == 1)
-				sample = src_buf[i] - 128;
-			else {
-				for (int j = src_bytes_per_sample; j > 0; --j) {
-					sample <<= 8;
-					sample += src_buf[i * src_bytes_per_sample + j - 1];
-				}
+			switch (src_bytes_per_sample) {
+				case 1:  Convert8(src, out, n); break;
+				case 3:  Convert24(src, out, n); break;
+				case 4:  Convert32(src, out, n); break;
+				default: ConvertGeneric(src, out, n, src_bytes_per_sample); break;
 			}
-
-			if (static_cast<size_t>(src_bytes_per_sample) > sizeof(Target))
-				sample /= 1LL << (src_bytes_per_sample - sizeof(Target)) * 8;
-			else if (static_cast<size_t>(src_bytes_per_sample) < sizeof(Target))
-				sample *=  1LL << (sizeof(Target) - src_bytes_per_sample ) * 8;
-
-			dest[i] = static_cast<Target>(sample);
-		}
+		});
 	}
 };
 
 /// Floating point -> 16 bit signed machine-endian audio converter
-template<class Source, class Target>
+template<class Source>
 class FloatConvertAudioProvider final : public AudioProviderWrapper {
-	mutable std::vector<Source> src_buf;
-
 public:
 	FloatConvertAudioProvider(std::unique_ptr<AudioProvider> src) : AudioProviderWrapper(std::move(src)) {
-		bytes_per_sample = sizeof(Target);
+		bytes_per_sample = sizeof(int16_t);
 		float_samples = false;
 	}
 
+	std::string GetDecodeKey() const override {
+		return source->GetDecodeKey() + "/float";
+	}
+
 	void FillBuffer(void *buf, int64_t start, int64_t count64) const override {
 		auto count = static_cast<size_t>(count64);
 		assert(count == count64);
 
-		src_buf.resize(count * channels);
-		source->GetAudio(&src_buf[0], start, count);
-
-		auto dest = static_cast<Target*>(buf);
-
-		for (size_t i = 0; i < static_cast<size_t>(count * channels); ++i) {
-			Source expanded;
-			if (src_buf[i] < 0)
-				expanded = static_cast<Target>(-src_buf[i] * std::numeric_limits<Target>::min());
-			else
-				expanded = static_cast<Target>(src_buf[i] * std::numeric_limits<Target>::max());
-
-			dest[i] = expanded < std::numeric_limits<Target>::min() ? std::numeric_limits<Target>::min() :
-			          expanded > std::numeric_limits<Target>::max() ? std::numeric_limits<Target>::max() :
-			                                                          static_cast<Target>(expanded);
-		}
+		auto dest = static_cast<int16_t*>(buf);
+		ForEachChunk(*source, start, count, [&](const uint8_t *src, size_t offset, size_t n) {
+			ConvertFloat(reinterpret_cast<const Source *>(src), dest + offset * channels, n * channels);
+		});
 	}
 };
 
 /// Non-mono 16-bit signed machine-endian -> mono 16-bit signed machine endian converter
 class DownmixAudioProvider final : public AudioProviderWrapper {
 	int src_channels;
-	mutable std::vector<int16_t> src_buf;
 
 public:
 	DownmixAudioProvider(std::unique_ptr<AudioProvider> src) : AudioProviderWrapper(std::move(src)) {
@@ -117,21 +258,25 @@ public:
 		channels = 1;
 	}
 
+	std::string GetDecodeKey() const override {
+		return source->GetDecodeKey() + "/mono";
+	}
+
 	void FillBuffer(void *buf, int64_t start, int64_t count64) const override {
 		auto count = static_cast<size_t>(count64);
 		assert(count == count64);
 
-		src_buf.resize(count * src_channels);
-		source->GetAudio(&src_buf[0], start, count);
-
-		auto dst = static_cast<int16_t*>(buf);
-		// Just average the channels together
-		while (count-- > 0) {
-			int sum = 0;
-			for (int c = 0; c < src_channels; ++c)
-				sum += src_buf[count * src_channels + c];
-			dst[count] = static_cast<int16_t>(sum / src_channels);
-		}
+		auto dest = static_cast<int16_t*>(buf);
+		ForEachChunk(*source, start, count, [&](const uint8_t *bytes, size_t offset, size_t n) {
+			auto src = reinterpret_cast<const int16_t *>(bytes);
+			// Just average the channels together
+			switch (src_channels) {
+				case 2:  DownmixStereo(src, dest + offset, n); break;
+				case 6:  DownmixFixed<6>(src, dest + offset, n); break;
+				case 8:  DownmixFixed<8>(src, dest + offset, n); break;
+				default: DownmixGeneric(src, dest + offset, n, src_channels); break;
+			}
+		});
 	}
 };
 
@@ -145,6 +290,14 @@ public:
 		decoded_samples = decoded_samples * 2;
 	}
 
+	std::string GetDecodeKey() const override {
+		return source->GetDecodeKey() + "/double";
+	}
+
+	void Prefetch(int64_t start, int64_t count) const override {
+		source->Prefetch(start / 2, count / 2 + 1);
+	}
+
 	void FillBuffer(void *buf, int64_t start, int64_t count) const override {
 		int16_t *src, *dst = static_cast<int16_t *>(buf);
 
@@ -178,13 +331,13 @@ std::unique_ptr<AudioProvider> CreateConvertAudioProvider(std::unique_ptr<AudioP
 	if (provider->AreSamplesFloat()) {
 		LOG_D("audio_provider") << "Converting float to S16";
 		if (provider->GetBytesPerSample() == sizeof(float))
-			provider = agi::make_unique<FloatConvertAudioProvider<float, int16_t>>(std::move(provider));
+			provider = agi::make_unique<FloatConvertAudioProvider<float>>(std::move(provider));
 		else
-			provider = agi::make_unique<FloatConvertAudioProvider<double, int16_t>>(std::move(provider));
+			provider = agi::make_unique<FloatConvertAudioProvider<double>>(std::move(provider));
 	}
 	if (provider->GetBytesPerSample() != 2) {
 		LOG_D("audio_provider") << "Converting " << provider->GetBytesPerSample() << " bytes per sample or wrong endian to S16";
-		provider = agi::make_unique<BitdepthConvertAudioProvider<int16_t>>(std::move(provider));
+		provider = agi::make_unique<BitdepthConvertAudioProvider>(std::move(provider));
 	}
 
 	// We currently only support mono audio
@@ -16,6 +16,8 @@
 
 #include "libaegisub/audio/provider.h"
 
+#include "block_filler.h"
+
 #include <libaegisub/file_mapping.h>
 #include <libaegisub/format.h>
 #include <libaegisub/fs.h>
@@ -25,27 +27,34 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/interprocess/detail/os_thread_functions.hpp>
 #include <ctime>
-#include <thread>
 
 namespace {
 using namespace agi;
 
+/// Samples decoded by each unit of work of the background decoder
+const int64_t block_size = 1 << 20;
+
 class HDAudioProvider final : public AudioProviderWrapper {
 	mutable temp_file_mapping file;
-	std::atomic<bool> cancelled = {false};
-	std::thread decoder;
+	int wait_ms;
+	std::unique_ptr<AudioBlockFiller> filler;
 
 	void FillBuffer(void *buf, int64_t start, int64_t count) const override {
-		auto missing = std::min(count, start + count - decoded_samples);
-		if (missing > 0) {
-			memset(static_cast<int16_t*>(buf) + count - missing, 0, missing * bytes_per_sample);
-			count -= missing;
-		}
+		if (start + count > decoded_samples && wait_ms > 0)
+			filler->Wait(start, count, wait_ms);
 
-		if (count > 0) {
-			start *= bytes_per_sample;
-			count *= bytes_per_sample;
-			memcpy(buf, file.read(start, count), count);
+		auto out = static_cast<char *>(buf);
+		while (count > 0) {
+			auto block = start / block_size;
+			auto read_count = std::min(count, (block + 1) * block_size - start);
+			auto bytes = read_count * bytes_per_sample;
+			if (filler->IsDone(block))
+				memcpy(out, file.read(start * bytes_per_sample, bytes), bytes);
+			else
+				memset(out, 0, bytes);
+			out += bytes;
+			start += read_count;
+			count -= read_count;
 		}
 	}
 
@@ -59,31 +68,42 @@ class HDAudioProvider final : public AudioProviderWrapper {
 	}
 
 public:
-	HDAudioProvider(std::unique_ptr<AudioProvider> src, agi::fs::path const& dir)
+	HDAudioProvider(std::unique_ptr<AudioProvider> src, agi::fs::path const& dir, int wait_ms)
 	: AudioProviderWrapper(std::move(src))
 	, file(dir / CacheFilename(dir), num_samples * bytes_per_sample)
+	, wait_ms(wait_ms)
 	{
-		decoded_samples = 0;
-		decoder = std::thread([&] {
-			int64_t block = 65536;
-			for (int64_t i = 0; i < num_samples; i += block) {
-				if (cancelled) break;
-				block = std::min(block, num_samples - i);
-				source->GetAudio(file.write(i * bytes_per_sample, block * bytes_per_sample), i, block);
-				decoded_samples += block;
-			}
-		});
-	}
+		// On 64-bit the first access maps the whole file and the mapping is
+		// never replaced after that, so mapping it up front makes reads and
+		// writes safe from several threads. 32-bit builds map a window at a
+		// time and have to stick to a single writer.
+		bool concurrent = sizeof(size_t) == 8 && num_samples > 0;
+		if (concurrent) {
+			file.read(0, num_samples * bytes_per_sample);
+			file.write(0, num_samples * bytes_per_sample);
+		}
 
-	~HDAudioProvider() {
-		cancelled = true;
-		decoder.join();
+		filler = agi::make_unique<AudioBlockFiller>(*source, block_size, decoded_samples,
+			[=](size_t, int64_t start, int64_t count) {
+				source->Prefetch(start + count, count);
+				if (concurrent)
+					source->GetAudio(file.write(start * bytes_per_sample, count * bytes_per_sample), start, count);
+				else {
+					// Write in smaller pieces so that each fits in the mapped window
+					for (int64_t i = start, end = start + count; i < end; i += 65536) {
+						auto n = std::min<int64_t>(65536, end - i);
+						source->GetAudio(file.write(i * bytes_per_sample, n * bytes_per_sample), i, n);
+					}
+				}
+			}, concurrent);
 	}
+
+	bool SupportsConcurrentReads() const override { return sizeof(size_t) == 8; }
 };
 }
 
 namespace agi {
-std::unique_ptr<AudioProvider> CreateHDAudioProvider(std::unique_ptr<AudioProvider> src, agi::fs::path const& dir) {
-	return agi::make_unique<HDAudioProvider>(std::move(src), dir);
+std::unique_ptr<AudioProvider> CreateHDAudioProvider(std::unique_ptr<AudioProvider> src, agi::fs::path const& dir, int wait_ms) {
+	return agi::make_unique<HDAudioProvider>(std::move(src), dir, wait_ms);
 }
 }
@@ -20,6 +20,7 @@
 #include "libaegisub/fs.h"
 #include "libaegisub/make_unique.h"
 
+#include <algorithm>
 #include <array>
 #include <vector>
 
@@ -28,36 +29,58 @@ using namespace agi;
 
 struct IndexPoint {
 	uint64_t start_byte;
+	uint64_t start_sample;
 	uint64_t num_samples;
 };
 
 struct file_ended {};
 
 class PCMAudioProvider : public AudioProvider {
-	void FillBuffer(void *buf, int64_t start, int64_t count) const override {
-		auto write_buf = static_cast<char *>(buf);
-		auto bps = bytes_per_sample * channels;
-		uint64_t pos = 0;
-
-		for (auto ip : index_points) {
-			if (count == 0) break;
-			if (pos + ip.num_samples <= (uint64_t)start) {
-				pos += ip.num_samples;
-				continue;
-			}
-
-			auto read_offset = start - pos;
-			auto read_count = std::min<size_t>(count, ip.num_samples - read_offset);
-			auto bytes = read_count * bps;
-			memcpy(write_buf, file.read(ip.start_byte + read_offset * bps, bytes), bytes);
+	/// Get the first index point which contains samples at or after sample
+	std::vector<IndexPoint>::const_iterator FindIndexPoint(int64_t sample) const {
+		auto it = std::upper_bound(index_points.begin(), index_points.end(), (uint64_t)sample,
+			[](uint64_t sample, IndexPoint const& ip) { return sample < ip.start_sample; });
+		return it == index_points.begin() ? it : it - 1;
+	}
 
-			write_buf += bytes;
+	/// Call fn(byte offset, byte count) for each contiguous range of the file
+	/// which holds the samples [start, start + count)
+	template<typename Func>
+	void ForEachRange(int64_t start, int64_t count, Func&& fn) const {
+		auto bps = bytes_per_sample * channels;
+		for (auto it = FindIndexPoint(start); count > 0 && it != index_points.end(); ++it) {
+			auto read_offset = start - it->start_sample;
+			if (read_offset >= it->num_samples) continue;
+			auto read_count = std::min<uint64_t>(count, it->num_samples - read_offset);
+			fn(it->start_byte + read_offset * bps, read_count * bps);
 			count -= read_count;
 			start += read_count;
-			pos += ip.num_samples;
 		}
 	}
 
+	void FillBuffer(void *buf, int64_t start, int64_t count) const override {
+		auto write_buf = static_cast<char *>(buf);
+		ForEachRange(start, count, [&](uint64_t offset, uint64_t bytes) {
+			memcpy(write_buf, file.read(offset, bytes), bytes);
+			write_buf += bytes;
+		});
+	}
+
+public:
+	/// On 64-bit the whole file is mapped while reading the header and never
+	/// remapped, so reads don't touch any shared mutable state
+	bool SupportsConcurrentReads() const override { return sizeof(size_t) == 8; }
+
+	std::string GetDecodeKey() const override { return "PCM"; }
+
+	void Prefetch(int64_t start, int64_t count) const override {
+		start = std::max<int64_t>(start, 0);
+		count = std::min(count, num_samples - start);
+		ForEachRange(start, count, [&](uint64_t offset, uint64_t bytes) {
+			file.prefetch(offset, bytes);
+		});
+	}
+
 protected:
 	mutable read_file_mapping file;
 	uint64_t file_pos = 0;
@@ -186,7 +209,7 @@ public:
 				else if (chunk_fcc == Impl::data_id()) {
 					if (!channels || !sample_rate || !bytes_per_sample)
 						throw AudioProviderError("Found 'data' chunk without format being set.");
-					index_points.emplace_back(IndexPoint{file_pos, chunk_size / bytes_per_sample / channels});
+					index_points.emplace_back(IndexPoint{file_pos, (uint64_t)num_samples, chunk_size / bytes_per_sample / channels});
 					num_samples += chunk_size / bytes_per_sample / channels;
 				}
 				// There's a bunch of other chunk types. They're all dumb.
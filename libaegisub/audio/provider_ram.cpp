@@ -16,11 +16,12 @@
 
 #include "libaegisub/audio/provider.h"
 
+#include "block_filler.h"
+
 #include "libaegisub/make_unique.h"
 
 #include <array>
 #include <boost/container/stable_vector.hpp>
-#include <thread>
 
 namespace {
 using namespace agi;
@@ -34,17 +35,16 @@ class RAMAudioProvider final : public AudioProviderWrapper {
 #else
 	boost::container::stable_vector<std::array<char, CacheBlockSize>> blockcache;
 #endif
-	std::atomic<bool> cancelled = {false};
-	std::thread decoder;
+	int wait_ms;
+	std::unique_ptr<AudioBlockFiller> filler;
 
 	void FillBuffer(void *buf, int64_t start, int64_t count) const override;
 
 public:
-	RAMAudioProvider(std::unique_ptr<AudioProvider> src)
+	RAMAudioProvider(std::unique_ptr<AudioProvider> src, int wait_ms)
 	: AudioProviderWrapper(std::move(src))
+	, wait_ms(wait_ms)
 	{
-		decoded_samples = 0;
-
 		try {
 			blockcache.resize((source->GetNumSamples() * source->GetBytesPerSample() + CacheBlockSize - 1) >> CacheBits);
 		}
@@ -52,36 +52,32 @@ public:
 			throw AudioProviderError("Not enough memory available to cache in RAM");
 		}
 
-		decoder = std::thread([&] {
-			int64_t readsize = CacheBlockSize / source->GetBytesPerSample();
-			for (size_t i = 0; i < blockcache.size(); i++) {
-				if (cancelled) break;
-				auto actual_read = std::min<int64_t>(readsize, num_samples - i * readsize);
-				source->GetAudio(&blockcache[i][0], i * readsize, actual_read);
-				decoded_samples += actual_read;
-			}
-		});
+		filler = agi::make_unique<AudioBlockFiller>(*source, CacheBlockSize / bytes_per_sample, decoded_samples,
+			[=](size_t block, int64_t start, int64_t count) {
+				// Let the source start reading the next block from disk
+				// while this one is being decoded
+				source->Prefetch(start + count, count);
+				source->GetAudio(&blockcache[block][0], start, count);
+			});
 	}
 
-	~RAMAudioProvider() {
-		cancelled = true;
-		decoder.join();
-	}
+	bool SupportsConcurrentReads() const override { return true; }
 };
 
 void RAMAudioProvider::FillBuffer(void *buf, int64_t start, int64_t count) const {
+	if (start + count > decoded_samples && wait_ms > 0)
+		filler->Wait(start, count, wait_ms);
+
 	auto charbuf = static_cast<char *>(buf);
 	for (int64_t bytes_remaining = count * bytes_per_sample; bytes_remaining; ) {
-		if (start >= decoded_samples) {
-			memset(charbuf, 0, bytes_remaining);
-			break;
-		}
-
 		const int i = (start * bytes_per_sample) >> CacheBits;
 		const int start_offset = (start * bytes_per_sample) & (CacheBlockSize-1);
 		const int read_size = std::min<int>(bytes_remaining, CacheBlockSize - start_offset);
 
-		memcpy(charbuf, &blockcache[i][start_offset], read_size);
+		if (filler->IsDone(i))
+			memcpy(charbuf, &blockcache[i][start_offset], read_size);
+		else
+			memset(charbuf, 0, read_size);
 		charbuf += read_size;
 		bytes_remaining -= read_size;
 		start += read_size / bytes_per_sample;
@@ -90,7 +86,7 @@ void RAMAudioProvider::FillBuffer(void *buf, int64_t start, int64_t count) const
 }
 
 namespace agi {
-std::unique_ptr<AudioProvider> CreateRAMAudioProvider(std::unique_ptr<AudioProvider> src) {
-	return agi::make_unique<RAMAudioProvider>(std::move(src));
+std::unique_ptr<AudioProvider> CreateRAMAudioProvider(std::unique_ptr<AudioProvider> src, int wait_ms) {
+	return agi::make_unique<RAMAudioProvider>(std::move(src), wait_ms);
 }
 }
@@ -18,6 +18,11 @@
 
 #include "libaegisub/util.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 namespace {
 	std::function<void (agi::dispatch::Thunk)> invoke_main;
 
@@ -40,6 +45,49 @@ namespace {
 	public:
 		SerialQueue() { }
 	};
+
+	class ThreadedSerialQueue final : public agi::dispatch::Queue {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<agi::dispatch::Thunk> thunks;
+		bool stopping = false;
+		std::thread thread;
+
+		void DoInvoke(agi::dispatch::Thunk thunk) override {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				thunks.push_back(std::move(thunk));
+			}
+			cv.notify_one();
+		}
+
+		void Run() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				cv.wait(lock, [&]{ return stopping || !thunks.empty(); });
+				if (thunks.empty()) return;
+
+				auto thunk = std::move(thunks.front());
+				thunks.pop_front();
+				lock.unlock();
+				thunk();
+				lock.lock();
+			}
+		}
+
+	public:
+		ThreadedSerialQueue() : thread([=] { Run(); }) { }
+
+		~ThreadedSerialQueue() {
+			// Finish everything already queued before shutting down
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			cv.notify_one();
+			thread.join();
+		}
+	};
 }
 
 namespace agi { namespace dispatch {
@@ -61,6 +109,8 @@ void Queue::Async(Thunk thunk) {
 }
 
 void Queue::Sync(Thunk thunk) {
+	std::mutex m;
+	std::condition_variable cv;
 	std::exception_ptr e;
 	bool done = false;
 	DoInvoke([&]{
@@ -70,8 +120,12 @@ void Queue::Sync(Thunk thunk) {
 		catch (...) {
 			e = std::current_exception();
 		}
+		std::lock_guard<std::mutex> l(m);
 		done = true;
+		cv.notify_all();
 	});
+	std::unique_lock<std::mutex> l(m);
+	cv.wait(l, [&]{ return done; });
 	if (e) std::rethrow_exception(e);
 }
 
@@ -89,4 +143,8 @@ std::unique_ptr<Queue> Create() {
 	return std::unique_ptr<Queue>(new SerialQueue);
 }
 
+std::unique_ptr<Queue> CreateThreaded() {
+	return std::unique_ptr<Queue>(new ThreadedSerialQueue);
+}
+
 } }
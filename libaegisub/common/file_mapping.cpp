@@ -26,6 +26,9 @@
 
 #ifdef _WIN32
 #include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 using namespace boost::interprocess;
@@ -136,6 +139,26 @@ const char *read_file_mapping::read(int64_t offset, uint64_t length) {
 	return map(offset, length, read_only, file_size, file, region, mapping_start);
 }
 
+void read_file_mapping::prefetch(int64_t offset, uint64_t length) {
+#ifndef _WIN32
+	if (length == 0 || offset < 0 || (uint64_t)offset >= file_size) return;
+	length = std::min<uint64_t>(length, file_size - offset);
+	auto data = map(offset, length, read_only, file_size, file, region, mapping_start);
+
+	// madvise requires a page-aligned start address
+	static const uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+	auto addr = reinterpret_cast<uintptr_t>(data);
+	auto aligned = addr & ~page_mask;
+	auto start = reinterpret_cast<void *>(aligned);
+	length += addr - aligned;
+
+	// The range is about to be streamed through once, so let the kernel
+	// read ahead aggressively and drop the pages once they've been read
+	madvise(start, length, MADV_SEQUENTIAL);
+	madvise(start, length, MADV_WILLNEED);
+#endif
+}
+
 temp_file_mapping::temp_file_mapping(fs::path const& filename, uint64_t size)
 : file(filename, true)
 , file_size(size)
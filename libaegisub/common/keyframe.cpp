@@ -19,77 +19,88 @@
 
 #include "libaegisub/keyframe.h"
 
-#include <sstream>
-
+#include "libaegisub/file_mapping.h"
 #include "libaegisub/io.h"
-#include "libaegisub/line_iterator.h"
+#include "line_scan.h"
 
+#include <algorithm>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/range/algorithm/copy.hpp>
 
 namespace {
-std::vector<int> agi_keyframes(std::istream &file) {
-	double fps;
-	std::string fps_str;
-	file >> fps_str;
-	file >> fps;
+using agi::line_scan::for_each_line;
+
+std::vector<int> agi_keyframes(const char *begin, const char *end) {
+	// Skip the "fps" token and the frame rate, which may share a line
+	auto skip_token = [&] {
+		while (begin != end && isspace((unsigned char)*begin)) ++begin;
+		while (begin != end && !isspace((unsigned char)*begin)) ++begin;
+	};
+	skip_token();
+	skip_token();
 
-	return std::vector<int>(agi::line_iterator<int>(file), agi::line_iterator<int>());
+	std::vector<int> ret;
+	for_each_line(begin, end, [&](const char *line, const char *line_end) {
+		int frame;
+		if (agi::line_scan::parse_int(line, line_end, frame))
+			ret.push_back(frame);
+	});
+	return ret;
 }
 
-std::vector<int> enumerated_keyframes(std::istream &file, char (*func)(std::string const&)) {
+std::vector<int> enumerated_keyframes(const char *begin, const char *end, char (*func)(const char *, const char *)) {
 	int count = 0;
 	std::vector<int> ret;
-	for (auto line : agi::line_iterator<std::string>(file)) {
-		char c = tolower(func(line));
+	for_each_line(begin, end, [&](const char *line, const char *line_end) {
+		char c = tolower(func(line, line_end));
 		if (c == 'i')
 			ret.push_back(count++);
 		else if (c == 'p' || c == 'b')
 			++count;
-	}
+	});
 	return ret;
 }
 
-std::vector<int> indexed_keyframes(std::istream &file, int (*func)(std::string const&)) {
+std::vector<int> indexed_keyframes(const char *begin, const char *end, int (*func)(const char *, const char *)) {
 	std::vector<int> ret;
-	for (auto line : agi::line_iterator<std::string>(file)) {
-		int frame_no = func(line);
+	for_each_line(begin, end, [&](const char *line, const char *line_end) {
+		int frame_no = func(line, line_end);
 		if (frame_no >= 0)
 			ret.push_back(frame_no);
-	}
+	});
 	return ret;
 }
 
-char xvid(std::string const& line) {
-	return line.empty() ? 0 : line[0];
+char xvid(const char *line, const char *end) {
+	return line == end ? 0 : *line;
 }
 
-char divx(std::string const& line) {
-	char chrs[] = "IPB";
-	for (int i = 0; i < 3; ++i) {
-		std::string::size_type pos = line.find(chrs[i]);
-		if (pos != line.npos)
-			return line[pos];
+char divx(const char *line, const char *end) {
+	for (char chr : {'I', 'P', 'B'}) {
+		auto pos = std::find(line, end, chr);
+		if (pos != end)
+			return *pos;
 	}
 	return 0;
 }
 
-char x264(std::string const& line) {
-	std::string::size_type pos = line.find("type:");
-	if (pos == line.npos || pos + 5 >= line.size()) return 0;
-	return line[pos + 5];
+char x264(const char *line, const char *end) {
+	static const char type[] = "type:";
+	auto pos = std::search(line, end, type, type + 5);
+	if (end - pos <= 5) return 0;
+	return pos[5];
 }
 
-int wwxd(std::string const& line) {
-	if (line.empty() || line[0] == '#')
+int wwxd(const char *line, const char *end) {
+	if (line == end || *line == '#')
 		return -1;
-	std::istringstream ss(line);
 	int frame_no;
-	char frame_type;
-	ss >> frame_no >> frame_type;
-	if (ss.fail())
+	line = agi::line_scan::parse_int(line, end, frame_no);
+	if (line)
+		line = std::find_if(line, end, [](char c) { return !isspace((unsigned char)c); });
+	if (!line || line == end)
 		throw agi::keyframe::KeyframeFormatParseError("WWXD keyframe file not in qpfile format");
-	if (frame_type == 'I')
+	if (*line == 'I')
 		return frame_no;
 	return -1;
 }
@@ -105,19 +116,21 @@ void Save(agi::fs::path const& filename, std::vector<int> const& keyframes) {
 }
 
 std::vector<int> Load(agi::fs::path const& filename) {
-	auto file = io::Open(filename);
-	std::istream &is(*file);
-
-	std::string header;
-	getline(is, header);
-
-	if (header == "# keyframe format v1") return agi_keyframes(is);
-	if (boost::starts_with(header, "# XviD 2pass stat file")) return enumerated_keyframes(is, xvid);
-	if (boost::starts_with(header, "# ffmpeg 2-pass log file, using xvid codec")) return enumerated_keyframes(is, xvid);
-	if (boost::starts_with(header, "# avconv 2-pass log file, using xvid codec")) return enumerated_keyframes(is, xvid);
-	if (boost::starts_with(header, "##map version")) return enumerated_keyframes(is, divx);
-	if (boost::starts_with(header, "#options:")) return enumerated_keyframes(is, x264);
-	if (boost::starts_with(header, "# WWXD log file, using qpfile format")) return indexed_keyframes(is, wwxd);
+	// x264 stats files used as keyframe sources can be many megabytes, so
+	// scan them in place rather than reading them line by line into strings
+	read_file_mapping file(filename);
+	auto end = file.read() + file.size();
+	auto begin = line_scan::skip_bom(file.read(), end);
+	std::string header(begin, line_scan::line_end(begin, end));
+	begin = line_scan::next_line(begin, end);
+
+	if (header == "# keyframe format v1") return agi_keyframes(begin, end);
+	if (boost::starts_with(header, "# XviD 2pass stat file")) return enumerated_keyframes(begin, end, xvid);
+	if (boost::starts_with(header, "# ffmpeg 2-pass log file, using xvid codec")) return enumerated_keyframes(begin, end, xvid);
+	if (boost::starts_with(header, "# avconv 2-pass log file, using xvid codec")) return enumerated_keyframes(begin, end, xvid);
+	if (boost::starts_with(header, "##map version")) return enumerated_keyframes(begin, end, divx);
+	if (boost::starts_with(header, "#options:")) return enumerated_keyframes(begin, end, x264);
+	if (boost::starts_with(header, "# WWXD log file, using qpfile format")) return indexed_keyframes(begin, end, wwxd);
 
 	throw UnknownKeyframeFormatError("File header does not match any known formats");
 }
@@ -0,0 +1,100 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#pragma once
+
+#include <climits>
+#include <cstring>
+
+namespace agi {
+	/// Helpers for parsing line-based ASCII text files straight out of a
+	/// memory mapping of the file, without copying each line into a string
+	namespace line_scan {
+		/// Skip a UTF-8 byte order mark at the start of a buffer
+		inline const char *skip_bom(const char *begin, const char *end) {
+			if (end - begin >= 3 && !memcmp(begin, "\xEF\xBB\xBF", 3))
+				return begin + 3;
+			return begin;
+		}
+
+		/// Get the end of the line starting at begin, not including the CR of
+		/// a CRLF line ending
+		inline const char *line_end(const char *begin, const char *end) {
+			auto eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+			if (!eol) eol = end;
+			if (eol > begin && eol[-1] == '\r') --eol;
+			return eol;
+		}
+
+		/// Get the start of the line after the one starting at begin
+		inline const char *next_line(const char *begin, const char *end) {
+			auto eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+			return eol ? eol + 1 : end;
+		}
+
+		/// Does the buffer hold only ASCII text, so that it reads the same in
+		/// any ASCII-compatible encoding?
+		inline bool is_ascii(const char *begin, const char *end) {
+			for (; begin != end; ++begin) {
+				unsigned char c = *begin;
+				if (c == 0 || c >= 0x80) return false;
+			}
+			return true;
+		}
+
+		/// @brief Call func(begin, end) for each line in a buffer
+		///
+		/// Line endings are stripped as by line_iterator
+		template<typename Func>
+		void for_each_line(const char *begin, const char *end, Func&& func) {
+			while (begin != end) {
+				auto eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+				auto next = eol ? eol + 1 : end;
+				if (!eol) eol = end;
+				func(begin, eol > begin && eol[-1] == '\r' ? eol - 1 : eol);
+				begin = next;
+			}
+		}
+
+		/// @brief Parse a decimal integer at the start of a line
+		/// @param[out] out Parsed value
+		/// @return Pointer to just after the digits, or nullptr if there was no
+		///         integer in range
+		///
+		/// Accepts what operator>> would: leading whitespace, an optional sign
+		/// and then digits
+		inline const char *parse_int(const char *begin, const char *end, int &out) {
+			while (begin != end && (*begin == ' ' || (*begin >= '\t' && *begin <= '\r')))
+				++begin;
+			bool negative = false;
+			if (begin != end && (*begin == '-' || *begin == '+'))
+				negative = *begin++ == '-';
+			if (begin == end || *begin < '0' || *begin > '9')
+				return nullptr;
+
+			long long value = 0;
+			for (; begin != end && *begin >= '0' && *begin <= '9'; ++begin) {
+				value = value * 10 + (*begin - '0');
+				if (value > (long long)INT_MAX + 1)
+					return nullptr;
+			}
+			if (negative) value = -value;
+			if (value > INT_MAX) return nullptr;
+			out = (int)value;
+			return begin;
+		}
+	}
+}
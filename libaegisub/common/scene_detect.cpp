@@ -0,0 +1,268 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+#include "libaegisub/scene_detect.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+/// Frames per batch handed to a worker
+const size_t batch_size = 256;
+/// Target width of thumbnails
+const size_t thumbnail_width = 160;
+
+using Histogram = std::array<uint32_t, 64>;
+
+/// Add a row of bytes to a row of 16-bit sums
+void accumulate(const uint8_t *src, size_t count, uint16_t *sums) {
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		auto lo = reinterpret_cast<__m128i *>(sums + i);
+		auto hi = reinterpret_cast<__m128i *>(sums + i + 8);
+		_mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo), _mm_unpacklo_epi8(px, zero)));
+		_mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi), _mm_unpackhi_epi8(px, zero)));
+	}
+#endif
+	for (; i < count; ++i)
+		sums[i] += src[i];
+}
+
+/// Sum of absolute differences of two buffers whose size is a multiple of 16
+uint64_t sad(const uint8_t *a, const uint8_t *b, size_t size) {
+	uint64_t total = 0;
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+	}
+	// Thumbnails are small enough that each lane's sum fits in 32 bits
+	total = (uint32_t)_mm_cvtsi128_si32(acc) + (uint64_t)(uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+	for (; i < size; ++i)
+		total += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	return total;
+}
+
+/// Median of a small range of differences, or 0 if it is empty
+double median_luma(std::vector<agi::FrameDifference> const& d, size_t begin, size_t end) {
+	if (begin >= end) return 0;
+	std::vector<double> values;
+	for (size_t i = begin; i < end; ++i)
+		values.push_back(d[i].luma);
+	auto mid = values.begin() + values.size() / 2;
+	std::nth_element(values.begin(), mid, values.end());
+	return *mid;
+}
+}
+
+namespace agi {
+struct SceneDetector::Batch {
+	/// Frame number of the first thumbnail added to this batch
+	int first = 0;
+	/// Number of thumbnails added to this batch
+	size_t count = 0;
+	/// Does pixels start with the thumbnail of the frame before first?
+	bool has_previous = false;
+	/// Thumbnails, with a slot before the first for the previous frame
+	std::vector<uint8_t> pixels;
+};
+
+SceneDetector::SceneDetector() : SceneDetector(Settings()) { }
+
+SceneDetector::SceneDetector(Settings settings)
+: settings(settings)
+, current(new Batch)
+{
+	// The thread adding frames is busy decoding them, so leave it a core
+	size_t threads = std::max(2u, std::min(std::thread::hardware_concurrency(), 9u)) - 1;
+	for (size_t i = 0; i < threads; ++i)
+		workers.emplace_back([=] { Work(); });
+}
+
+SceneDetector::~SceneDetector() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void SceneDetector::Shrink(const uint8_t *data, ptrdiff_t pitch, int bytes_per_pixel, uint8_t *dst) {
+	size_t columns = thumb_width * factor;
+	uint32_t area = (uint32_t)(factor * factor);
+	for (size_t ty = 0; ty < thumb_height; ++ty, dst += thumb_pitch) {
+		std::fill(column_sums.begin(), column_sums.end(), 0);
+		for (size_t r = 0; r < factor; ++r) {
+			auto row = data + (ptrdiff_t)(ty * factor + r) * pitch;
+			if (bytes_per_pixel == 4) {
+				for (size_t x = 0; x < columns; ++x) {
+					auto px = row + x * 4;
+					luma_row[x] = (uint8_t)((29 * px[0] + 150 * px[1] + 77 * px[2] + 128) >> 8);
+				}
+				row = luma_row.data();
+			}
+			accumulate(row, columns, column_sums.data());
+		}
+
+		for (size_t tx = 0; tx < thumb_width; ++tx) {
+			uint32_t sum = 0;
+			for (size_t i = 0; i < factor; ++i)
+				sum += column_sums[tx * factor + i];
+			dst[tx] = (uint8_t)((sum + area / 2) / area);
+		}
+		std::fill(dst + thumb_width, dst + thumb_pitch, 0);
+	}
+}
+
+void SceneDetector::AddFrame(const uint8_t *data, size_t width, size_t height, ptrdiff_t pitch, int bytes_per_pixel) {
+	if (!frame_count) {
+		if (!width || !height)
+			throw SceneDetectorError("Frames must not be empty");
+		this->width = width;
+		this->height = height;
+		// Summing up to 256 rows of bytes fits in the 16-bit column sums
+		factor = std::min<size_t>({std::max<size_t>(1, width / thumbnail_width), height, 256});
+		thumb_width = width / factor;
+		thumb_height = height / factor;
+		thumb_pitch = (thumb_width + 15) & ~15;
+		column_sums.resize(thumb_width * factor);
+		luma_row.resize(thumb_width * factor);
+		current->pixels.resize(thumb_pitch * thumb_height * (batch_size + 1));
+	}
+	else if (width != this->width || height != this->height)
+		throw SceneDetectorError("All frames must be the same size");
+
+	size_t thumb_size = thumb_pitch * thumb_height;
+	Shrink(data, pitch, bytes_per_pixel, &current->pixels[thumb_size * (current->count + 1)]);
+	++frame_count;
+	if (++current->count == batch_size)
+		Submit();
+}
+
+void SceneDetector::Submit() {
+	if (!current->count) return;
+
+	size_t thumb_size = thumb_pitch * thumb_height;
+	std::unique_ptr<Batch> next(new Batch);
+	next->first = current->first + (int)current->count;
+	next->has_previous = true;
+	next->pixels.resize(thumb_size * (batch_size + 1));
+	memcpy(&next->pixels[0], &current->pixels[thumb_size * current->count], thumb_size);
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		// Don't let decoding get too far ahead of the workers
+		work_done.wait(lock, [&] { return outstanding < workers.size() * 2; });
+		queue.push_back(std::move(current));
+		++outstanding;
+	}
+	work_ready.notify_one();
+	current = std::move(next);
+}
+
+void SceneDetector::Work() {
+	for (;;) {
+		std::unique_ptr<Batch> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_ready.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (stopping) return;
+			batch = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		size_t thumb_size = thumb_pitch * thumb_height;
+		double pixels = double(thumb_width * thumb_height);
+		std::vector<Histogram> histograms(batch->count + 1);
+		for (size_t i = batch->has_previous ? 0 : 1; i <= batch->count; ++i) {
+			auto& hist = histograms[i];
+			hist.fill(0);
+			auto thumb = &batch->pixels[thumb_size * i];
+			for (size_t y = 0; y < thumb_height; ++y) {
+				for (size_t x = 0; x < thumb_width; ++x)
+					++hist[thumb[y * thumb_pitch + x] >> 2];
+			}
+		}
+
+		std::vector<FrameDifference> results(batch->count);
+		for (size_t i = batch->has_previous ? 0 : 1; i < batch->count; ++i) {
+			auto prev = &batch->pixels[thumb_size * i];
+			results[i].luma = sad(prev, prev + thumb_size, thumb_size) / pixels;
+			uint64_t distance = 0;
+			for (size_t bin = 0; bin < histograms[i].size(); ++bin)
+				distance += histograms[i][bin] > histograms[i + 1][bin]
+					? histograms[i][bin] - histograms[i + 1][bin]
+					: histograms[i + 1][bin] - histograms[i][bin];
+			results[i].histogram = distance / (2 * pixels);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t end = batch->first + batch->count;
+			if (differences.size() < end)
+				differences.resize(end);
+			std::copy(results.begin(), results.end(), differences.begin() + batch->first);
+			--outstanding;
+		}
+		work_done.notify_all();
+	}
+}
+
+std::vector<FrameDifference> const& SceneDetector::Differences() {
+	Submit();
+	std::unique_lock<std::mutex> lock(mutex);
+	work_done.wait(lock, [&] { return outstanding == 0; });
+	return differences;
+}
+
+std::vector<int> SceneDetector::SceneChanges() {
+	auto const& d = Differences();
+	std::vector<int> changes;
+	if (d.empty()) return changes;
+
+	changes.push_back(0);
+	size_t window = std::max(settings.window, 1);
+	for (size_t n = 1; n < d.size(); ++n) {
+		if (d[n].luma < settings.min_luma || d[n].histogram < settings.min_histogram)
+			continue;
+		if ((int)n - changes.back() < settings.min_scene_length)
+			continue;
+
+		// Medians rather than means so that another cut nearby doesn't
+		// hide this one
+		double before = median_luma(d, std::max<size_t>(1, n - std::min(n, window)), n);
+		double after = median_luma(d, n + 1, std::min(d.size(), n + 1 + window));
+		if (d[n].luma >= settings.peak_ratio * std::max(before, after))
+			changes.push_back((int)n);
+	}
+	return changes;
+}
+}
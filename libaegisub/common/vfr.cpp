@@ -19,14 +19,15 @@
 #include "libaegisub/vfr.h"
 
 #include "libaegisub/charset.h"
+#include "libaegisub/file_mapping.h"
 #include "libaegisub/io.h"
 #include "libaegisub/line_iterator.h"
+#include "line_scan.h"
 
 #include <algorithm>
 #include <boost/interprocess/streams/bufferstream.hpp>
 #include <boost/range/algorithm.hpp>
 #include <cmath>
-#include <functional>
 #include <iterator>
 
 namespace {
@@ -52,6 +53,87 @@ void normalize_timecodes(std::vector<int> &timecodes) {
 		boost::for_each(timecodes, [=](int &tc) { tc -= front; });
 }
 
+/// A run of frame times which lie on the digital straight line
+/// time = (num * frame + offset) / den relative to the first frame
+struct LineFit {
+	size_t length;
+	int64_t num;
+	int64_t den;
+	int64_t offset;
+};
+
+/// @brief Find the longest run of frame times starting at start which lies on
+///        a single digital straight line
+/// @param times Frame start times
+/// @param start First frame of the run
+/// @param step Smaller of the two frame durations allowed in the run
+///
+/// Frame durations in a constant frame rate run can only ever be step or
+/// step + 1 ms, so subtracting step from each time leaves a sequence which
+/// goes up by 0 or 1 each frame. That is recognised incrementally with the
+/// arithmetic digital straight segment algorithm of Debled-Rennesson and
+/// Reveillès, which tracks the line mu <= a * x - b * y < mu + b through its
+/// upper and lower leaning points.
+LineFit fit_line(std::vector<int> const& times, size_t start, int64_t step) {
+	struct Point { int64_t x, y; };
+	int64_t a = 0, b = 1, mu = 0;
+	Point uf{0, 0}, ul{0, 0}, lf{0, 0}, ll{0, 0};
+
+	size_t x = 1;
+	for (; start + x < times.size(); ++x) {
+		int64_t dy = times[start + x] - times[start + x - 1] - step;
+		if (dy < 0 || dy > 1) break;
+
+		Point m{(int64_t)x, times[start + x] - times[start] - step * (int64_t)x};
+		int64_t r = a * m.x - b * m.y;
+		if (r >= mu && r < mu + b) {
+			if (r == mu) ul = m;
+			if (r == mu + b - 1) ll = m;
+		}
+		else if (r == mu - 1) {
+			lf = ll;
+			ul = m;
+			a = m.y - uf.y;
+			b = m.x - uf.x;
+			mu = a * m.x - b * m.y;
+		}
+		else if (r == mu + b) {
+			uf = ul;
+			ll = m;
+			a = m.y - lf.y;
+			b = m.x - lf.x;
+			mu = a * m.x - b * m.y - b + 1;
+		}
+		else
+			break;
+	}
+
+	return {x, step * b + a, b, -mu};
+}
+
+/// @brief Find the last element of a sorted vector whose key is at most value
+/// @param v Vector sorted by key, whose first key must be at most value
+/// @param hint Index to start searching from, or v.size() for none
+/// @param key Function which gets the key of an element
+///
+/// When value is at or after the element at hint, this gallops forward from
+/// there with doubling steps, so a series of lookups with increasing values
+/// costs time proportional to how far each moves rather than log(v.size())
+template<typename T, typename Key>
+size_t seek(std::vector<T> const& v, size_t hint, int value, Key key) {
+	auto before = [&](int value, T const& e) { return value < key(e); };
+	if (hint >= v.size() || value < key(v[hint]))
+		return std::upper_bound(v.begin(), v.begin() + std::min(hint, v.size()), value, before) - v.begin() - 1;
+
+	size_t step = 1;
+	while (hint + step < v.size() && key(v[hint + step]) <= value) {
+		hint += step;
+		step *= 2;
+	}
+	auto end = v.begin() + std::min(hint + step, v.size());
+	return std::upper_bound(v.begin() + hint + 1, end, value, before) - v.begin() - 1;
+}
+
 // A "start,end,fps" line in a v1 timecode file
 struct TimecodeRange {
 	int start;
@@ -137,7 +219,7 @@ Framerate::Framerate(double fps)
 {
 	if (fps < 0.) throw InvalidFramerate("FPS must be greater than zero");
 	if (fps > 1000.) throw InvalidFramerate("FPS must not be greater than 1000");
-	timecodes.push_back(0);
+	Compress({0});
 }
 
 Framerate::Framerate(int64_t numerator, int64_t denominator, bool drop)
@@ -148,44 +230,113 @@ Framerate::Framerate(int64_t numerator, int64_t denominator, bool drop)
 	if (numerator <= 0 || denominator <= 0)
 		throw InvalidFramerate("Numerator and denominator must both be greater than zero");
 	if (numerator / denominator > 1000) throw InvalidFramerate("FPS must not be greater than 1000");
-	timecodes.push_back(0);
+	Compress({0});
 }
 
-void Framerate::SetFromTimecodes() {
+void Framerate::SetFromTimecodes(std::vector<int> timecodes) {
 	validate_timecodes(timecodes);
 	normalize_timecodes(timecodes);
 	denominator = default_denominator;
 	numerator = (timecodes.size() - 1) * denominator * 1000 / timecodes.back();
 	last = (timecodes.size() - 1) * denominator * 1000;
+	Compress(timecodes);
 }
 
-Framerate::Framerate(std::vector<int> timecodes)
-: timecodes(std::move(timecodes))
-{
-	SetFromTimecodes();
+void Framerate::Compress(std::vector<int> const& timecodes) {
+	segments.clear();
+	for (size_t start = 0; start < timecodes.size(); ) {
+		LineFit fit{1, 0, 1, 0};
+		if (start + 1 < timecodes.size()) {
+			int64_t step = timecodes[start + 1] - timecodes[start];
+			fit = fit_line(timecodes, start, step);
+			// The first frame duration may have been the longer of the two
+			if (step > 0 && start + fit.length < timecodes.size()) {
+				auto alt = fit_line(timecodes, start, step - 1);
+				if (alt.length > fit.length)
+					fit = alt;
+			}
+		}
+
+		segments.push_back(Segment{(int)start, timecodes[start], fit.num, fit.den, fit.offset});
+		start += fit.length;
+	}
+
+	frame_count = (int)timecodes.size();
+	last_time = timecodes.back();
 }
 
-Framerate::Framerate(std::initializer_list<int> timecodes)
-: timecodes(timecodes)
-{
-	SetFromTimecodes();
+size_t Framerate::SegmentAtFrame(int frame, size_t hint) const {
+	return seek(segments, hint, frame, [](Segment const& seg) { return seg.start_frame; });
+}
+
+size_t Framerate::SegmentAtTime(int ms, size_t hint) const {
+	// With duplicate times this is the last of the segments starting then, as
+	// EXACT picks the last of the frames sharing a time
+	return seek(segments, hint, ms, [](Segment const& seg) { return seg.start_time; });
+}
+
+Framerate::Framerate(std::vector<int> timecodes) {
+	SetFromTimecodes(std::move(timecodes));
+}
+
+Framerate::Framerate(std::initializer_list<int> timecodes) {
+	SetFromTimecodes(timecodes);
 }
 
 Framerate::Framerate(fs::path const& filename)
 : denominator(default_denominator)
 {
+	// Timecode files are practically always plain ASCII, and when the header
+	// is there's no need to detect the charset of the file and convert each
+	// line from it, so parse straight out of a mapping of the file instead
+	{
+		read_file_mapping mapping(filename);
+		auto begin = line_scan::skip_bom(mapping.read(), mapping.read() + mapping.size());
+		auto end = mapping.read() + mapping.size();
+		auto header_end = line_scan::line_end(begin, end);
+		if (line_scan::is_ascii(begin, header_end)) {
+			std::string line(begin, header_end);
+			begin = line_scan::next_line(begin, end);
+			if (line == "# timecode format v2") {
+				std::vector<int> timecodes;
+				timecodes.reserve((end - begin) / 8);
+				line_scan::for_each_line(begin, end, [&](const char *line, const char *line_end) {
+					int time;
+					if (line_scan::parse_int(line, line_end, time))
+						timecodes.push_back(time);
+				});
+				SetFromTimecodes(std::move(timecodes));
+				return;
+			}
+			if (line == "# timecode format v1" || line.substr(0, 7) == "Assume ") {
+				// v1 files are a handful of override ranges, so just skip
+				// the charset detection
+				boost::interprocess::ibufferstream file(begin, end - begin);
+				if (line[0] == '#')
+					line = *line_iterator<std::string>(file);
+				std::vector<int> timecodes;
+				numerator = v1_parse(line_iterator<std::string>(file), line, timecodes, last);
+				Compress(timecodes);
+				return;
+			}
+			throw UnknownFormat(line);
+		}
+	}
+
 	auto file = agi::io::Open(filename);
 	auto encoding = agi::charset::Detect(filename);
 	auto line = *line_iterator<std::string>(*file, encoding);
+	std::vector<int> timecodes;
 	if (line == "# timecode format v2") {
 		copy(line_iterator<int>(*file, encoding), line_iterator<int>(), back_inserter(timecodes));
-		SetFromTimecodes();
+		SetFromTimecodes(std::move(timecodes));
 		return;
 	}
 	if (line == "# timecode format v1" || line.substr(0, 7) == "Assume ") {
 		if (line[0] == '#')
 			line = *line_iterator<std::string>(*file, encoding);
 		numerator = v1_parse(line_iterator<std::string>(*file, encoding), line, timecodes, last);
+		Compress(timecodes);
 		return;
 	}
 
@@ -197,12 +348,34 @@ void Framerate::Save(fs::path const& filename, int length) const {
 	auto &out = file.Get();
 
 	out << "# timecode format v2\n";
-	boost::copy(timecodes, std::ostream_iterator<int>(out, "\n"));
-	for (int written = (int)timecodes.size(); written < length; ++written)
-		out << TimeAtFrame(written) << std::endl;
+	size_t hint = segments.size();
+	for (int frame = 0; frame < std::max(frame_count, length); ++frame)
+		out << TimeAtFrame(frame, EXACT, hint) << '\n';
 }
 
 int Framerate::FrameAtTime(int ms, Time type) const {
+	size_t hint = segments.size();
+	return FrameAtTime(ms, type, hint);
+}
+
+int Framerate::TimeAtFrame(int frame, Time type) const {
+	size_t hint = segments.size();
+	return TimeAtFrame(frame, type, hint);
+}
+
+void Framerate::FramesAtTimes(const int *ms, size_t count, int *out, Time type) const {
+	size_t hint = segments.size();
+	for (size_t i = 0; i < count; ++i)
+		out[i] = FrameAtTime(ms[i], type, hint);
+}
+
+void Framerate::TimesAtFrames(const int *frames, size_t count, int *out, Time type) const {
+	size_t hint = segments.size();
+	for (size_t i = 0; i < count; ++i)
+		out[i] = TimeAtFrame(frames[i], type, hint);
+}
+
+int Framerate::FrameAtTime(int ms, Time type, size_t& hint) const {
 	// With X ms per frame, this should return 0 for:
 	// EXACT: [0, X - 1]
 	// START: [1 - X , 0]
@@ -217,42 +390,63 @@ int Framerate::FrameAtTime(int ms, Time type) const {
 	// EXACT
 
 	if (type == START)
-		return FrameAtTime(ms - 1) + 1;
+		return FrameAtTime(ms - 1, EXACT, hint) + 1;
 	if (type == END)
-		return FrameAtTime(ms - 1);
+		return FrameAtTime(ms - 1, EXACT, hint);
 
 	if (ms < 0)
 		return int((ms * numerator / denominator - 999) / 1000);
 
-	if (ms > timecodes.back())
-		return int((ms * numerator - last + denominator - 1) / denominator / 1000) + (int)timecodes.size() - 1;
+	if (ms > last_time)
+		return int((ms * numerator - last + denominator - 1) / denominator / 1000) + frame_count - 1;
+
+	hint = SegmentAtTime(ms, hint);
+	auto const& seg = segments[hint];
+	int64_t length = (hint + 1 == segments.size() ? frame_count : segments[hint + 1].start_frame) - seg.start_frame;
 
-	return (int)distance(lower_bound(timecodes.rbegin(), timecodes.rend(), ms, std::greater<int>()), timecodes.rend()) - 1;
+	// Largest k with (num * k + offset) / den <= ms - start_time
+	int64_t k = length - 1;
+	if (seg.num > 0)
+		k = std::min(k, ((ms - seg.start_time + 1) * seg.den - seg.offset - 1) / seg.num);
+	return seg.start_frame + (int)k;
 }
 
-int Framerate::TimeAtFrame(int frame, Time type) const {
-	if (type == START) {
-		int prev = TimeAtFrame(frame - 1);
-		int cur = TimeAtFrame(frame);
+int Framerate::TimeAtFrame(int frame, Time type, size_t& hint) const {
+	if (type == START || type == END) {
+		// START is halfway between the previous frame and this one, and END
+		// halfway between this frame and the next
+		int first = type == START ? frame - 1 : frame;
+		int a, b;
+		if (first >= 0 && first + 1 < frame_count) {
+			// Usually both frames are in the same segment, so look it up once
+			hint = SegmentAtFrame(first, hint);
+			auto const& seg = segments[hint];
+			int64_t k = first - seg.start_frame;
+			a = seg.start_time + int((seg.num * k + seg.offset) / seg.den);
+			if (hint + 1 == segments.size() || segments[hint + 1].start_frame > first + 1)
+				b = seg.start_time + int((seg.num * (k + 1) + seg.offset) / seg.den);
+			else
+				b = segments[hint + 1].start_time;
+		}
+		else {
+			a = TimeAtFrame(first, EXACT, hint);
+			b = TimeAtFrame(first + 1, EXACT, hint);
+		}
 		// + 1 as these need to round up for the case of two frames 1 ms apart
-		return prev + (cur - prev + 1) / 2;
-	}
-
-	if (type == END) {
-		int cur = TimeAtFrame(frame);
-		int next = TimeAtFrame(frame + 1);
-		return cur + (next - cur + 1) / 2;
+		return a + (b - a + 1) / 2;
 	}
 
 	if (frame < 0)
 		return (int)(frame * denominator * 1000 / numerator);
 
-	if (frame >= (signed)timecodes.size()) {
-		int64_t frames_past_end = frame - (int)timecodes.size() + 1;
+	if (frame >= frame_count) {
+		int64_t frames_past_end = frame - frame_count + 1;
 		return int((frames_past_end * 1000 * denominator + last + numerator / 2) / numerator);
 	}
 
-	return timecodes[frame];
+	hint = SegmentAtFrame(frame, hint);
+	auto const& seg = segments[hint];
+	return seg.start_time + int((seg.num * (frame - seg.start_frame) + seg.offset) / seg.den);
 }
 
 void Framerate::SmpteAtFrame(int frame, int *h, int *m, int *s, int *f) const {
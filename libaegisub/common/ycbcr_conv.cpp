@@ -16,6 +16,12 @@
 
 #include "libaegisub/ycbcr_conv.h"
 
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 namespace {
 double matrix_coefficients[][3] = {
 	{.299, .587, .114},    // BT.601
@@ -85,14 +91,137 @@ void ycbcr_converter::init_dst(ycbcr_matrix dst_mat, ycbcr_range dst_range) {
 	}
 }
 
+void ycbcr_converter::init_fixed() {
+	// Every coefficient is in (-1, 1), so 14 fractional bits fit in an
+	// int16_t and a full row of products of 8-bit values fits in an int32_t
+	for (size_t i = 0; i < 9; ++i)
+		to_ycbcr_fixed[i] = static_cast<int16_t>(std::lround(to_ycbcr[i] * (1 << 14)));
+	// Fold the rounding of the final shift into the offset
+	for (size_t i = 0; i < 3; ++i)
+		shift_to_fixed[i] = static_cast<int32_t>(std::lround((shift_to[i] + .5) * (1 << 14)));
+
+	// The chroma coefficients of the inverse go up to about 2.1 for TV range,
+	// so only 13 fractional bits are left for them
+	for (size_t i = 0; i < 9; ++i)
+		from_ycbcr_fixed[i] = static_cast<int16_t>(std::lround(from_ycbcr[i] * (1 << 13)));
+	for (size_t i = 0; i < 3; ++i)
+		shift_from_fixed[i] = static_cast<int16_t>(shift_from[i]);
+}
+
 ycbcr_converter::ycbcr_converter(ycbcr_matrix mat, ycbcr_range range) {
 	init_src(mat, range);
 	init_dst(mat, range);
+	init_fixed();
 }
 
 ycbcr_converter::ycbcr_converter(ycbcr_matrix src_mat, ycbcr_range src_range, ycbcr_matrix dst_mat, ycbcr_range dst_range) {
 	init_src(src_mat, src_range);
 	init_dst(dst_mat, dst_range);
+	init_fixed();
 }
+
+void ycbcr_converter::bgra_to_ycbcr(const uint8_t *src, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr) const {
+	auto const& m = to_ycbcr_fixed;
+	uint8_t *dst[] = {y, cb, cr};
+	size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	// Eight pixels per iteration: widen to 16 bits, multiply-add B*kb + G*kg
+	// and R*kr + 0 for each pixel with pmaddwd, then sum the pairs
+	__m128i coeff[3], shift[3];
+	for (int c = 0; c < 3; ++c) {
+		int16_t kr = m[c * 3], kg = m[c * 3 + 1], kb = m[c * 3 + 2];
+		coeff[c] = _mm_setr_epi16(kb, kg, kr, 0, kb, kg, kr, 0);
+		shift[c] = _mm_set1_epi32(shift_to_fixed[c]);
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	auto row = [&](__m128i lo, __m128i hi, int c) {
+		__m128i a = _mm_madd_epi16(lo, coeff[c]);
+		__m128i b = _mm_madd_epi16(hi, coeff[c]);
+		a = _mm_add_epi32(a, _mm_srli_epi64(a, 32));
+		b = _mm_add_epi32(b, _mm_srli_epi64(b, 32));
+		__m128i sum = _mm_castps_si128(_mm_shuffle_ps(
+			_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		return _mm_srai_epi32(_mm_add_epi32(sum, shift[c]), 14);
+	};
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i px0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+		__m128i px1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16));
+		__m128i lo0 = _mm_unpacklo_epi8(px0, zero), hi0 = _mm_unpackhi_epi8(px0, zero);
+		__m128i lo1 = _mm_unpacklo_epi8(px1, zero), hi1 = _mm_unpackhi_epi8(px1, zero);
+		for (int c = 0; c < 3; ++c) {
+			__m128i words = _mm_packs_epi32(row(lo0, hi0, c), row(lo1, hi1, c));
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(dst[c] + i), _mm_packus_epi16(words, words));
+		}
+	}
+#endif
+
+	for (; i < count; ++i) {
+		int b = src[i * 4], g = src[i * 4 + 1], r = src[i * 4 + 2];
+		for (int c = 0; c < 3; ++c) {
+			int v = (r * m[c * 3] + g * m[c * 3 + 1] + b * m[c * 3 + 2] + shift_to_fixed[c]) >> 14;
+			dst[c][i] = static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+		}
+	}
 }
 
+void ycbcr_converter::ycbcr_to_bgra(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, size_t count, uint8_t *dst) const {
+	auto const& m = from_ycbcr_fixed;
+	size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	// Eight pixels per iteration: widen the shifted components to 16 bits,
+	// interleave them as (Y, Cb) and (Cr, 1) pairs and multiply-add each pair
+	// with pmaddwd, with the rounding term riding along as the coefficient of 1
+	__m128i coeff_ycb[3], coeff_cr[3];
+	for (int c = 0; c < 3; ++c) {
+		coeff_ycb[c] = _mm_setr_epi16(m[c * 3], m[c * 3 + 1], m[c * 3], m[c * 3 + 1],
+			m[c * 3], m[c * 3 + 1], m[c * 3], m[c * 3 + 1]);
+		coeff_cr[c] = _mm_setr_epi16(m[c * 3 + 2], 1 << 12, m[c * 3 + 2], 1 << 12,
+			m[c * 3 + 2], 1 << 12, m[c * 3 + 2], 1 << 12);
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i shift_y = _mm_set1_epi16(shift_from_fixed[0]);
+	const __m128i shift_cb = _mm_set1_epi16(shift_from_fixed[1]);
+	const __m128i shift_cr = _mm_set1_epi16(shift_from_fixed[2]);
+
+	for (; i + 8 <= count; i += 8) {
+		auto load = [&](const uint8_t *src, __m128i shift) {
+			__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i));
+			return _mm_add_epi16(_mm_unpacklo_epi8(v, zero), shift);
+		};
+		__m128i vy = load(y, shift_y), vcb = load(cb, shift_cb), vcr = load(cr, shift_cr);
+		__m128i ycb_lo = _mm_unpacklo_epi16(vy, vcb), ycb_hi = _mm_unpackhi_epi16(vy, vcb);
+		__m128i cr_lo = _mm_unpacklo_epi16(vcr, one), cr_hi = _mm_unpackhi_epi16(vcr, one);
+
+		__m128i rgb[3];
+		for (int c = 0; c < 3; ++c) {
+			__m128i lo = _mm_add_epi32(_mm_madd_epi16(ycb_lo, coeff_ycb[c]), _mm_madd_epi16(cr_lo, coeff_cr[c]));
+			__m128i hi = _mm_add_epi32(_mm_madd_epi16(ycb_hi, coeff_ycb[c]), _mm_madd_epi16(cr_hi, coeff_cr[c]));
+			__m128i words = _mm_packs_epi32(_mm_srai_epi32(lo, 13), _mm_srai_epi32(hi, 13));
+			rgb[c] = _mm_packus_epi16(words, words);
+		}
+
+		__m128i bg = _mm_unpacklo_epi8(rgb[2], rgb[1]);
+		__m128i r0 = _mm_unpacklo_epi8(rgb[0], zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_unpacklo_epi16(bg, r0));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 16), _mm_unpackhi_epi16(bg, r0));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		int vy = y[i] + shift_from_fixed[0];
+		int vcb = cb[i] + shift_from_fixed[1];
+		int vcr = cr[i] + shift_from_fixed[2];
+		for (int c = 0; c < 3; ++c) {
+			int v = (vy * m[c * 3] + vcb * m[c * 3 + 1] + vcr * m[c * 3 + 2] + (1 << 12)) >> 13;
+			dst[i * 4 + 2 - c] = static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+		}
+		dst[i * 4 + 3] = 0;
+	}
+}
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#pragma once
+
+#include <libaegisub/exception.h>
+#include <libaegisub/fs_fwd.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace agi {
+class AudioProvider;
+
+DEFINE_EXCEPTION(AudioEnvelopeError, Exception);
+
+/// Summary of a span of audio samples
+struct AudioEnvelopePoint {
+	int16_t min = 0; ///< Lowest sample
+	int16_t max = 0; ///< Highest sample
+	double rms = 0;  ///< Root mean square of the samples
+};
+
+/// @class AudioEnvelope
+/// @brief Min/max/RMS pyramid over a whole 16-bit mono audio stream
+///
+/// Level 0 summarises blocks of block_size samples and each level above
+/// merges pairs of nodes from the one below, so any range of blocks can be
+/// summarised from O(log n) nodes without touching the audio again.
+class AudioEnvelope {
+public:
+	/// Number of samples summarised by each node of the lowest level, which
+	/// is the finest resolution queries can resolve
+	static const int block_size = 256;
+
+private:
+	struct Node {
+		int16_t min;
+		int16_t max;
+		double sum_squares;
+	};
+
+	int64_t num_samples = 0;
+	int sample_rate = 0;
+	std::vector<std::vector<Node>> levels;
+
+	/// Fill in every level above the first from the one below it
+	void BuildPyramid();
+
+public:
+	/// @brief Compute the envelope of all of the audio from a provider
+	/// @param provider 16-bit mono provider to read from; must be safe to
+	///                 read from several threads at once
+	///
+	/// The audio is read in one pass, split into chunks which are read and
+	/// summarised in parallel. Cache providers which are still decoding are
+	/// waited on.
+	/// @throws AudioEnvelopeError if a cache provider stops making progress
+	AudioEnvelope(AudioProvider const& provider);
+
+	/// @brief Load an envelope previously written with Save()
+	/// @param file File to read
+	/// @param provider Provider the envelope is expected to be for
+	/// @throws AudioEnvelopeError if the file is not an envelope of audio of
+	///         the same length and sample rate as the provider
+	AudioEnvelope(fs::path const& file, AudioProvider const& provider);
+
+	/// Write the envelope to a file
+	void Save(fs::path const& file) const;
+
+	int64_t GetNumSamples() const { return num_samples; }
+	int GetSampleRate() const { return sample_rate; }
+
+	/// @brief Summarise a range of samples
+	/// @param start First sample
+	/// @param end One past the last sample
+	///
+	/// The range is widened to whole blocks.
+	AudioEnvelopePoint Summarise(int64_t start, int64_t end) const;
+};
+}
@@ -20,6 +20,7 @@
 #include <libaegisub/fs_fwd.h>
 
 #include <atomic>
+#include <string>
 #include <vector>
 
 namespace agi {
@@ -54,6 +55,19 @@ public:
 
 	/// Does this provider benefit from external caching?
 	virtual bool NeedsCache() const { return false; }
+
+	/// Identifies the decoder, track and conversions which produced the
+	/// samples, for keying caches of data derived from them
+	virtual std::string GetDecodeKey() const { return std::string(); }
+
+	/// Hint that the samples [start, start + count) are going to be read
+	/// soon, so that providers reading from disk can start fetching them
+	/// before they're needed. Purely advisory.
+	virtual void Prefetch(int64_t, int64_t) const { }
+
+	/// Can GetAudio be called from several threads at once? The cache
+	/// providers decode sources which can be on several threads.
+	virtual bool SupportsConcurrentReads() const { return false; }
 };
 
 /// Helper base class for an audio provider which wraps another provider
@@ -71,6 +85,18 @@ public:
 		bytes_per_sample = source->GetBytesPerSample();
 		float_samples = source->AreSamplesFloat();
 	}
+
+	void Prefetch(int64_t start, int64_t count) const override {
+		source->Prefetch(start, count);
+	}
+
+	std::string GetDecodeKey() const override {
+		return source->GetDecodeKey();
+	}
+
+	bool SupportsConcurrentReads() const override {
+		return source->SupportsConcurrentReads();
+	}
 };
 
 DEFINE_EXCEPTION(AudioProviderError, Exception);
@@ -88,8 +114,15 @@ std::unique_ptr<AudioProvider> CreatePCMAudioProvider(fs::path const& filename,
 
 std::unique_ptr<AudioProvider> CreateConvertAudioProvider(std::unique_ptr<AudioProvider> source_provider);
 std::unique_ptr<AudioProvider> CreateLockAudioProvider(std::unique_ptr<AudioProvider> source_provider);
-std::unique_ptr<AudioProvider> CreateHDAudioProvider(std::unique_ptr<AudioProvider> source_provider, fs::path const& dir);
-std::unique_ptr<AudioProvider> CreateRAMAudioProvider(std::unique_ptr<AudioProvider> source_provider);
+/// @brief Create a provider which decodes all of the source audio to disk in the background
+/// @param dir Directory to write the cache file to
+/// @param wait_ms How long reads of samples which haven't been decoded yet
+///                wait for them before returning silence
+std::unique_ptr<AudioProvider> CreateHDAudioProvider(std::unique_ptr<AudioProvider> source_provider, fs::path const& dir, int wait_ms = 0);
+/// @brief Create a provider which decodes all of the source audio to memory in the background
+/// @param wait_ms How long reads of samples which haven't been decoded yet
+///                wait for them before returning silence
+std::unique_ptr<AudioProvider> CreateRAMAudioProvider(std::unique_ptr<AudioProvider> source_provider, int wait_ms = 0);
 
 void SaveAudioClip(AudioProvider const& provider, fs::path const& path, int start_time, int end_time);
 }
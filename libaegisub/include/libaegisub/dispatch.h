@@ -46,5 +46,9 @@ namespace agi {
 
 		/// Create a new serial queue
 		std::unique_ptr<Queue> Create();
+
+		/// Create a new serial queue which runs its thunks in order on a
+		/// dedicated thread rather than on the thread which submitted them
+		std::unique_ptr<Queue> CreateThreaded();
 	}
 }
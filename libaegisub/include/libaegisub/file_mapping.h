@@ -45,6 +45,9 @@ namespace agi {
 		uint64_t size() const { return file_size; }
 		const char *read(int64_t offset, uint64_t length);
 		const char *read(); // Map the entire file
+		/// Ask the OS to start reading in the given range of the file, which
+		/// is about to be read through sequentially
+		void prefetch(int64_t offset, uint64_t length);
 	};
 
 	class temp_file_mapping {
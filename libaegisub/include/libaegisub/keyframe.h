@@ -29,7 +29,8 @@ namespace agi {
 		/// @param keyframes List of keyframes to save
 		void Save(agi::fs::path const& filename, std::vector<int> const& keyframes);
 
-		DEFINE_EXCEPTION(KeyframeFormatParseError, agi::InvalidInputException);
-		DEFINE_EXCEPTION(UnknownKeyframeFormatError, agi::InvalidInputException);
+		DEFINE_EXCEPTION(Error, agi::InvalidInputException);
+		DEFINE_EXCEPTION(KeyframeFormatParseError, Error);
+		DEFINE_EXCEPTION(UnknownKeyframeFormatError, Error);
 	}
 }
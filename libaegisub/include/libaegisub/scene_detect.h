@@ -0,0 +1,136 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+#pragma once
+
+#include <libaegisub/exception.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace agi {
+DEFINE_EXCEPTION(SceneDetectorError, InvalidInputException);
+
+/// How different a frame is from the one before it
+struct FrameDifference {
+	/// Mean absolute difference of the luma of the two frames, 0-255
+	double luma = 0;
+	/// Half the L1 distance between the luma histograms of the two frames,
+	/// from 0 for identical histograms to 1 for disjoint ones
+	double histogram = 0;
+};
+
+/// @class SceneDetector
+/// @brief Find scene changes in a sequence of video frames
+///
+/// Each frame is shrunk to a thumbnail about 160 pixels wide as it is added,
+/// on the calling thread, and batches of thumbnails are compared with the
+/// frame before them on worker threads. A frame starts a new scene when it
+/// differs from the previous frame by much more than the frames around it do,
+/// so cuts are found while motion and fades are not.
+class SceneDetector {
+public:
+	/// Tuning for what counts as a scene change
+	struct Settings {
+		/// Smallest luma difference which can be a scene change
+		double min_luma = 10.;
+		/// Smallest histogram difference which can be a scene change
+		double min_histogram = .15;
+		/// How many times bigger than the average difference of the
+		/// surrounding frames a scene change's difference must be
+		double peak_ratio = 2.5;
+		/// Number of frames on each side to average over
+		int window = 5;
+		/// Minimum number of frames between two scene changes
+		int min_scene_length = 4;
+	};
+
+private:
+	struct Batch;
+
+	Settings settings;
+
+	size_t width = 0;        ///< Width of the frames
+	size_t height = 0;       ///< Height of the frames
+	size_t factor = 1;       ///< Frame pixels per thumbnail pixel on each axis
+	size_t thumb_width = 0;  ///< Width of thumbnails
+	size_t thumb_height = 0; ///< Height of thumbnails
+	size_t thumb_pitch = 0;  ///< Thumbnail width padded to a multiple of 16
+
+	/// Column sums used while shrinking a row of blocks
+	std::vector<uint16_t> column_sums;
+	/// Row of luma converted from BGRA frames
+	std::vector<uint8_t> luma_row;
+
+	/// Batch being filled by AddFrame
+	std::unique_ptr<Batch> current;
+	/// Number of frames added so far
+	int frame_count = 0;
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	/// Batches waiting for a worker
+	std::deque<std::unique_ptr<Batch>> queue;
+	/// Number of batches queued or being worked on
+	size_t outstanding = 0;
+	bool stopping = false;
+	/// Differences of each frame from the one before it, filled in by the
+	/// workers; the first frame's is always zero
+	std::vector<FrameDifference> differences;
+
+	std::vector<std::thread> workers;
+
+	void Work();
+	/// Queue the current batch for the workers and start a new one
+	void Submit();
+	/// Shrink a frame into the thumbnail at dst
+	void Shrink(const uint8_t *data, ptrdiff_t pitch, int bytes_per_pixel, uint8_t *dst);
+
+public:
+	SceneDetector();
+	SceneDetector(Settings settings);
+	~SceneDetector();
+
+	/// @brief Add the next frame of the video
+	/// @param data First row of the frame
+	/// @param width Width in pixels
+	/// @param height Height in pixels
+	/// @param pitch Bytes between the starts of rows; may be negative
+	/// @param bytes_per_pixel 1 for a luma plane or 4 for BGRA
+	///
+	/// All frames must be the same size. The frame's pixels are not used after
+	/// this returns.
+	void AddFrame(const uint8_t *data, size_t width, size_t height, ptrdiff_t pitch, int bytes_per_pixel);
+
+	/// Wait for all of the added frames to be compared and get the difference
+	/// of each frame from the one before it
+	std::vector<FrameDifference> const& Differences();
+
+	/// @brief Wait for all of the added frames to be compared and get the
+	///        frames which start new scenes
+	/// @return Sorted frame numbers, always including frame 0 if any frames
+	///         were added
+	std::vector<int> SceneChanges();
+};
+}
@@ -67,14 +67,52 @@ class Framerate {
 	/// rounding past the end of the final override range.
 	int64_t last = 0;
 
-	/// Start time in milliseconds of each frame
-	std::vector<int> timecodes;
+	/// @brief A run of frames whose start times lie on one digital straight line
+	///
+	/// Frame start_frame + k starts at start_time + (num * k + offset) / den
+	/// milliseconds, rounded down. A constant frame rate is a single segment
+	/// regardless of how its times were rounded to milliseconds.
+	struct Segment {
+		int start_frame;
+		int start_time;
+		int64_t num;
+		int64_t den;
+		int64_t offset;
+	};
+
+	/// Start times of each frame, compressed into runs of constant frame rate
+	std::vector<Segment> segments;
+
+	/// Number of frames with explicit start times
+	int frame_count = 0;
+
+	/// Start time in milliseconds of the final frame with an explicit time
+	int last_time = 0;
 
 	/// Does this frame rate need drop frames and have them enabled?
 	bool drop = false;
 
-	/// Set FPS properties from the timecodes vector
-	void SetFromTimecodes();
+	/// Set FPS properties from a vector of frame start times
+	void SetFromTimecodes(std::vector<int> timecodes);
+
+	/// Build segments from a vector of frame start times
+	void Compress(std::vector<int> const& timecodes);
+
+	/// Get the index of the segment containing a frame in [0, frame_count),
+	/// searching forward from the segment at index hint when possible
+	size_t SegmentAtFrame(int frame, size_t hint) const;
+
+	/// Get the index of the last segment starting at or before a time in
+	/// [0, last_time], searching forward from the segment at index hint when
+	/// possible
+	size_t SegmentAtTime(int ms, size_t hint) const;
+
+	/// FrameAtTime and TimeAtFrame which start looking for the frame's segment
+	/// at hint and update it to the segment used, so that lookups in order
+	/// walk forward through the segments rather than searching all of them.
+	/// A hint of segments.size() means no hint.
+	int FrameAtTime(int ms, Time type, size_t& hint) const;
+	int TimeAtFrame(int frame, Time type, size_t& hint) const;
 public:
 	Framerate(Framerate const&) = default;
 	Framerate& operator=(Framerate const&) = default;
@@ -134,6 +172,26 @@ public:
 	/// results for all frame numbers
 	int TimeAtFrame(int frame, Time type = EXACT) const;
 
+	/// @brief Get the frames at each of an array of times
+	/// @param ms Times in milliseconds
+	/// @param count Number of times
+	/// @param[out] out Array of count frames, which may be the same as ms
+	/// @param type Time mode
+	///
+	/// Equivalent to calling FrameAtTime on each time, but each lookup carries
+	/// on from where the previous one finished, so converting sorted times is
+	/// a single forward walk over the frame rate changes
+	void FramesAtTimes(const int *ms, size_t count, int *out, Time type = EXACT) const;
+
+	/// @brief Get the times at each of an array of frames
+	/// @param frames Frame numbers
+	/// @param count Number of frames
+	/// @param[out] out Array of count times, which may be the same as frames
+	/// @param type Time mode
+	///
+	/// Equivalent to calling TimeAtFrame on each frame; see FramesAtTimes
+	void TimesAtFrames(const int *frames, size_t count, int *out, Time type = EXACT) const;
+
 	/// @brief Get the components of the SMPTE timecode for the given time
 	/// @param[out] h Hours component
 	/// @param[out] m Minutes component
@@ -193,7 +251,7 @@ public:
 	void Save(fs::path const& file, int length = -1) const;
 
 	/// Is this frame rate possibly variable?
-	bool IsVFR() const {return timecodes.size() > 1; }
+	bool IsVFR() const {return frame_count > 1; }
 
 	/// Does this represent a valid frame rate?
 	bool IsLoaded() const { return numerator > 0; }
@@ -15,6 +15,7 @@
 // Aegisub Project http://www.aegisub.org/
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
 #include <libaegisub/color.h>
@@ -40,6 +41,17 @@ class ycbcr_converter {
 	std::array<double, 3> shift_from;
 	std::array<double, 3> shift_to;
 
+	/// to_ycbcr and shift_to in 2.14 fixed point, for bulk conversions
+	std::array<int16_t, 9> to_ycbcr_fixed;
+	std::array<int32_t, 3> shift_to_fixed;
+
+	/// from_ycbcr in 3.13 fixed point and shift_from as integers, for bulk
+	/// conversions
+	std::array<int16_t, 9> from_ycbcr_fixed;
+	std::array<int16_t, 3> shift_from_fixed;
+
+	void init_fixed();
+
 	void init_dst(ycbcr_matrix dst_mat, ycbcr_range dst_range);
 	void init_src(ycbcr_matrix src_mat, ycbcr_range src_range);
 
@@ -87,6 +99,24 @@ public:
 			add(add(prod(to_ycbcr, input), shift_to), shift_from)));
 	}
 
+	/// @brief Convert a run of packed BGRA pixels from rgb to dst_mat/dst_range
+	/// @param src Pixels to convert, 4 bytes each in B, G, R, X order
+	/// @param count Number of pixels to convert
+	/// @param y, cb, cr Planes to write count bytes of each component to
+	///
+	/// Uses fixed point maths, so results may be off by one from
+	/// rgb_to_ycbcr().
+	void bgra_to_ycbcr(const uint8_t *src, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr) const;
+
+	/// @brief Convert a run of pixels from src_mat/src_range to packed BGRA
+	/// @param y, cb, cr Planes to read count bytes of each component from
+	/// @param count Number of pixels to convert
+	/// @param dst Buffer to write count * 4 bytes of B, G, R, 0 to
+	///
+	/// Uses fixed point maths, so results may be off by one from
+	/// ycbcr_to_rgb().
+	void ycbcr_to_bgra(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, size_t count, uint8_t *dst) const;
+
 	Color rgb_to_rgb(Color c) const {
 		auto arr = rgb_to_rgb(std::array<uint8_t, 3>{{c.r, c.g, c.b}});
 		return Color{arr[0], arr[1], arr[2], c.a};
@@ -36,13 +36,14 @@
 #include <libaegisub/exception.h>
 #include <libaegisub/format.h>
 #include <libaegisub/make_unique.h>
+#include <libaegisub/split.h>
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/trim.hpp>
 #include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <functional>
+#include <mutex>
 
 using namespace boost::adaptors;
 
@@ -98,7 +99,7 @@ template<> AssDialogueBlockOverride *AssOverrideParameter::Get<AssDialogueBlockO
 
 template<> void AssOverrideParameter::Set<std::string>(std::string new_value) {
 	omitted = false;
-	value = new_value;
+	value = std::move(new_value);
 	block.reset();
 }
 
@@ -174,9 +175,10 @@ struct AssOverrideTagProto {
 };
 
 static std::vector<AssOverrideTagProto> proto;
-static void load_protos() {
-	if (!proto.empty()) return;
-
+/// Indices into proto of the prototypes whose name starts with each
+/// character after the backslash, in the same order as in proto
+static std::vector<uint8_t> proto_index[256];
+static void init_protos() {
 	proto.resize(56);
 	int i = 0;
 
@@ -305,25 +307,48 @@ static void load_protos() {
 	proto[i].AddParam(VariableDataType::INT, AssParameterClass::RELATIVE_TIME_START,OPTIONAL_3 | OPTIONAL_4);
 	proto[i].AddParam(VariableDataType::FLOAT, AssParameterClass::NORMAL,OPTIONAL_2 | OPTIONAL_4);
 	proto[i].AddParam(VariableDataType::BLOCK);
+
+	// A tag can only match the prototypes which start with the same letter,
+	// so only those need to be compared against it
+	for (size_t idx = 0; idx < proto.size(); ++idx)
+		proto_index[static_cast<unsigned char>(proto[idx].name[1])].push_back(idx);
+}
+
+// Tags may be parsed from several threads at once
+static void load_protos() {
+	static std::once_flag flag;
+	std::call_once(flag, init_protos);
 }
 
-std::vector<std::string> tokenize(const std::string &text) {
-	std::vector<std::string> paramList;
+bool is_space(char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+agi::StringRange trimmed(std::string::const_iterator begin, std::string::const_iterator end) {
+	while (begin != end && is_space(*begin)) ++begin;
+	while (begin != end && is_space(*(end - 1))) --end;
+	return agi::StringRange(begin, end);
+}
+
+/// Split the parameters of a tag, starting at the given offset into the tag's
+/// text, into ranges of that text so that each parameter is only copied once
+std::vector<agi::StringRange> tokenize(const std::string &text, size_t offset) {
+	std::vector<agi::StringRange> paramList;
 	paramList.reserve(6);
 
-	if (text.empty())
+	if (offset >= text.size())
 		return paramList;
 
-	if (text[0] != '(') {
+	if (text[offset] != '(') {
 		// There's just one parameter (because there's no parentheses)
 		// This means text is all our parameters
-		paramList.emplace_back(boost::trim_copy(text));
+		paramList.push_back(trimmed(text.begin() + offset, text.end()));
 		return paramList;
 	}
 
 	// Ok, so there are parentheses used here, so there may be more than one parameter
 	// Enter fullscale parsing!
-	size_t i = 0, textlen = text.size();
+	size_t i = offset, textlen = text.size();
 	int parDepth = 1;
 	while (i < textlen && parDepth > 0) {
 		// Just skip until next ',' or ')', whichever comes first
@@ -344,7 +369,7 @@ std::vector<std::string> tokenize(const std::string &text) {
 			i++;
 		}
 		// i now points to the first character not member of this parameter
-		paramList.emplace_back(boost::trim_copy(text.substr(start, i - start)));
+		paramList.push_back(trimmed(text.begin() + start, text.begin() + i));
 	}
 
 	if (i+1 < textlen) {
@@ -355,11 +380,11 @@ std::vector<std::string> tokenize(const std::string &text) {
 	return paramList;
 }
 
-void parse_parameters(AssOverrideTag *tag, const std::string &text, AssOverrideTagProto::iterator proto_it) {
+void parse_parameters(AssOverrideTag *tag, const std::string &text, size_t offset, AssOverrideTagProto::iterator proto_it) {
 	tag->Clear();
 
 	// Tokenize text, attempting to find all parameters
-	std::vector<std::string> paramList = tokenize(text);
+	std::vector<agi::StringRange> paramList = tokenize(text, offset);
 	size_t totalPars = paramList.size();
 
 	int parsFlag = 1 << (totalPars - 1); // Get optional parameters flag
@@ -377,7 +402,8 @@ void parse_parameters(AssOverrideTag *tag, const std::string &text, AssOverrideT
 		if (!(curproto.optional & parsFlag) || curPar >= totalPars)
 			continue;
 
-		tag->Params.back().Set(paramList[curPar++]);
+		auto const& param = paramList[curPar++];
+		tag->Params.back().Set(std::string(param.begin(), param.end()));
 	}
 }
 
@@ -442,12 +468,15 @@ void AssOverrideTag::Clear() {
 
 void AssOverrideTag::SetText(const std::string &text) {
 	load_protos();
-	for (auto cur = proto.begin(); cur != proto.end(); ++cur) {
-		if (boost::starts_with(text, cur->name)) {
-			Name = cur->name;
-			parse_parameters(this, text.substr(Name.size()), cur);
-			valid = true;
-			return;
+	if (text.size() > 1 && text[0] == '\\') {
+		for (auto idx : proto_index[static_cast<unsigned char>(text[1])]) {
+			auto const& name = proto[idx].name;
+			if (text.compare(0, name.size(), name) == 0) {
+				Name = name;
+				parse_parameters(this, text, name.size(), proto.begin() + idx);
+				valid = true;
+				return;
+			}
 		}
 	}
 
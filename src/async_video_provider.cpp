@@ -19,28 +19,251 @@
 #include "ass_dialogue.h"
 #include "ass_file.h"
 #include "export_fixstyle.h"
+#include "options.h"
+#include "utils.h"
 #include "video_frame.h"
 #include "video_provider_manager.h"
 
 #include <libaegisub/dispatch.h>
 #include <libaegisub/log.h>
 
+#include <algorithm>
+#include <condition_variable>
+
 enum {
 	NEW_SUBS_FILE = -1,
 	SUBS_FILE_ALREADY_LOADED = -2
 };
 
 AsyncVideoProvider::AsyncVideoProvider(agi::fs::path const& video_filename, std::string const& colormatrix, agi::BackgroundRunner *br)
-: worker(agi::dispatch::Create())
+: worker(agi::dispatch::CreateThreaded())
 , source_provider(VideoProviderFactory::GetProvider(video_filename, colormatrix, br))
+, max_prefetched(std::max<int64_t>(1, OPT_GET("Provider/Video/Prefetch Frames")->GetInt()))
+, keyframes(source_provider->GetKeyFrames())
 {
 }
 
 AsyncVideoProvider::~AsyncVideoProvider() {
+	{
+		std::lock_guard<std::mutex> lock(prefetch_lock);
+		prefetch_queue.clear();
+	}
+
 	// Block until all currently queued jobs are complete
 	worker->Sync([]{});
 }
 
+std::shared_ptr<VideoFrame> AsyncVideoProvider::ProcFrame(int frame_number) {
+	// Find an unused buffer to use or allocate a new one if needed
+	std::shared_ptr<VideoFrame> frame;
+	for (auto& buffer : buffers) {
+		if (buffer.use_count() == 1) {
+			frame = buffer;
+			break;
+		}
+	}
+
+	// Frames handed to scripts can stay referenced until the Lua GC gets
+	// around to them, so past the cap allocate frames which are freed when
+	// released rather than growing the pool without bound
+	if (!frame) {
+		frame = std::make_shared<VideoFrame>();
+		if (buffers.size() < max_prefetched + extra_buffers)
+			buffers.push_back(frame);
+	}
+
+	try {
+		source_provider->GetFrame(frame_number, *frame);
+	}
+	catch (VideoProviderError const& err) { throw VideoProviderErrorEvent(err); }
+
+	decoder_pos = frame_number;
+	return frame;
+}
+
+std::shared_ptr<VideoFrame> AsyncVideoProvider::GetFrame(int frame) {
+	if (reading)
+		throw agi::InternalError("AsyncVideoProvider::GetFrame called from within ReadFrame");
+
+	// Pending frames in the same GOP which come before the requested one. The
+	// decoder has to run through them to get to the requested frame anyway,
+	// so keep them rather than seeking back for each of them later.
+	std::vector<int> gop_frames;
+	{
+		std::lock_guard<std::mutex> lock(prefetch_lock);
+		auto it = prefetched.find(frame);
+		if (it != prefetched.end()) {
+			auto ret = std::move(it->second);
+			prefetched.erase(it);
+			SchedulePrefetch();
+			return ret;
+		}
+
+		// Frames before this one were presumably skipped by the caller, so
+		// drop them rather than letting them block further prefetching
+		if (prefetched.size() >= max_prefetched)
+			prefetched.erase(prefetched.begin(), prefetched.lower_bound(frame));
+
+		prefetch_queue.erase(frame);
+		auto first = prefetch_queue.lower_bound(GopStart(frame));
+		auto last = first;
+		size_t room = prefetched.size() < max_prefetched ? max_prefetched - prefetched.size() : 0;
+		for (; room && last != prefetch_queue.end() && *last < frame; --room)
+			gop_frames.push_back(*last++);
+		prefetch_queue.erase(first, last);
+	}
+
+	std::vector<std::pair<int, std::shared_ptr<VideoFrame>>> decoded;
+	std::shared_ptr<VideoFrame> ret;
+	worker->Sync([&]{
+		for (int gop_frame : gop_frames) {
+			try {
+				decoded.emplace_back(gop_frame, ProcFrame(gop_frame));
+			}
+			catch (agi::Exception const&) { }
+		}
+
+		// A prefetch which had already taken the frame off the queue when
+		// it was checked above has finished by now, so use its result
+		// rather than decoding the frame again
+		{
+			std::lock_guard<std::mutex> lock(prefetch_lock);
+			auto it = prefetched.find(frame);
+			if (it != prefetched.end()) {
+				ret = std::move(it->second);
+				prefetched.erase(it);
+			}
+		}
+		if (!ret)
+			ret = ProcFrame(frame);
+	});
+
+	std::lock_guard<std::mutex> lock(prefetch_lock);
+	for (auto& gop_frame : decoded)
+		prefetched[gop_frame.first] = std::move(gop_frame.second);
+	SchedulePrefetch();
+	return ret;
+}
+
+void AsyncVideoProvider::ReadFrame(int frame, std::function<void (VideoFrame const&)> const& fn) {
+	if (reading)
+		throw agi::InternalError("AsyncVideoProvider::ReadFrame called from within ReadFrame");
+
+	// The view is only valid until the source provider is next asked for a
+	// frame, so park the worker after decoding it until the callback is done
+	// rather than copying it out
+	std::mutex m;
+	std::condition_variable cv;
+	bool ready = false, done = false;
+	VideoFrame view;
+	std::exception_ptr err;
+
+	worker->Async([&] {
+		try {
+			source_provider->GetFrameView(frame, view);
+			decoder_pos = frame;
+		}
+		catch (VideoProviderError const& e) {
+			err = std::make_exception_ptr(VideoProviderErrorEvent(e));
+		}
+
+		std::unique_lock<std::mutex> lock(m);
+		ready = true;
+		cv.notify_all();
+		cv.wait(lock, [&] { return done; });
+	});
+
+	struct release {
+		std::mutex &m;
+		std::condition_variable &cv;
+		bool &done;
+		~release() {
+			std::lock_guard<std::mutex> lock(m);
+			done = true;
+			cv.notify_all();
+		}
+	};
+
+	{
+		std::unique_lock<std::mutex> lock(m);
+		cv.wait(lock, [&] { return ready; });
+	}
+
+	release r{m, cv, done};
+	if (err)
+		std::rethrow_exception(err);
+
+	reading = true;
+	try {
+		fn(view);
+	}
+	catch (...) {
+		reading = false;
+		throw;
+	}
+	reading = false;
+}
+
+void AsyncVideoProvider::Prefetch(std::vector<int> frames) {
+	int last = GetFrameCount() - 1;
+	std::lock_guard<std::mutex> lock(prefetch_lock);
+	for (int frame : frames)
+		prefetch_queue.insert(mid(0, frame, last));
+	SchedulePrefetch();
+}
+
+int AsyncVideoProvider::GopStart(int frame) const {
+	auto it = upper_bound(begin(keyframes), end(keyframes), frame);
+	return it == begin(keyframes) ? 0 : *prev(it);
+}
+
+int AsyncVideoProvider::NextPrefetchFrame() {
+	// Sweep forwards from the decoder's current position so that the frames
+	// of each GOP are decoded in a single pass, and only seek backwards once
+	// nothing is left ahead of it
+	auto it = prefetch_queue.lower_bound(decoder_pos);
+	if (it == prefetch_queue.end())
+		it = prefetch_queue.begin();
+	int frame = *it;
+	prefetch_queue.erase(it);
+	return frame;
+}
+
+void AsyncVideoProvider::SchedulePrefetch() {
+	if (prefetch_pending || prefetch_queue.empty() || prefetched.size() >= max_prefetched)
+		return;
+	prefetch_pending = true;
+	worker->Async([=] { DoPrefetch(); });
+}
+
+void AsyncVideoProvider::DoPrefetch() {
+	int frame;
+	{
+		std::lock_guard<std::mutex> lock(prefetch_lock);
+		prefetch_pending = false;
+		if (prefetch_queue.empty()) return;
+		frame = NextPrefetchFrame();
+		if (prefetched.count(frame)) {
+			SchedulePrefetch();
+			return;
+		}
+	}
+
+	std::shared_ptr<VideoFrame> decoded;
+	try {
+		decoded = ProcFrame(frame);
+	}
+	catch (agi::Exception const&) {
+		// Leave reporting the error to GetFrame when the frame is actually
+		// requested
+	}
+
+	std::lock_guard<std::mutex> lock(prefetch_lock);
+	if (decoded)
+		prefetched[frame] = std::move(decoded);
+	SchedulePrefetch();
+}
+
 void AsyncVideoProvider::SetColorSpace(std::string const& matrix) {
 	worker->Async([=] { source_provider->SetColorSpace(matrix); });
 }
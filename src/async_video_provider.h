@@ -20,7 +20,10 @@
 #include <libaegisub/fs_fwd.h>
 
 #include <atomic>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 
 class AssDialogue;
@@ -58,9 +61,78 @@ class AsyncVideoProvider {
 	/// they can be rendered
 	std::atomic<uint_fast32_t> version{ 0 };
 
+	/// Reusable frame buffers, at most max_prefetched + extra_buffers of them
 	std::vector<std::shared_ptr<VideoFrame>> buffers;
 
+	/// Maximum number of decoded frames to hold waiting for GetFrame
+	const size_t max_prefetched;
+
+	/// Pooled buffers beyond the prefetched frames, for the frame being
+	/// displayed and the ones being decoded or read
+	static const size_t extra_buffers = 4;
+
+	/// Lock for the prefetch state, which is shared with the worker
+	std::mutex prefetch_lock;
+	/// Frames passed to Prefetch() which have not been decoded yet
+	std::set<int> prefetch_queue;
+	/// Frames decoded ahead of time, waiting to be picked up by GetFrame
+	std::map<int, std::shared_ptr<VideoFrame>> prefetched;
+	/// Is there a prefetch job queued on the worker?
+	bool prefetch_pending = false;
+
+	/// Keyframes of the video, used to group pending frames by GOP
+	std::vector<int> keyframes;
+	/// Frame most recently decoded by the source provider. Only touched on
+	/// the worker.
+	int decoder_pos = 0;
+
+	/// Is a ReadFrame() callback currently running? The worker is parked
+	/// while it does, so anything which waits on the worker would deadlock.
+	bool reading = false;
+
+	std::shared_ptr<VideoFrame> ProcFrame(int frame);
+
+	/// Get the first frame of the GOP containing the given frame
+	int GopStart(int frame) const;
+
+	/// Remove and return the pending frame which is cheapest to decode next.
+	/// Must be called with prefetch_lock held.
+	int NextPrefetchFrame();
+
+	/// Queue decoding of the next frame in prefetch_queue if there is room
+	/// for it. Must be called with prefetch_lock held.
+	void SchedulePrefetch();
+	/// Decode the next frame in prefetch_queue. Runs on the worker.
+	void DoPrefetch();
+
 public:
+	/// @brief Synchronously get a video frame
+	/// @param frame Frame number to get
+	/// @return The decoded frame, which the caller may hold on to for as long
+	///         as it likes. The buffer is only reused once all references to
+	///         it have been released.
+	std::shared_ptr<VideoFrame> GetFrame(int frame);
+
+	/// @brief Synchronously decode a frame and pass it to a callback without
+	///        copying it out of the video provider's buffers
+	/// @param frame Frame number to read
+	/// @param fn Callback which is given the frame. It runs on the calling
+	///           thread, and the frame is only valid until it returns.
+	///
+	/// Decoding is paused while the callback runs, so it must not call
+	/// GetFrame() or ReadFrame() itself.
+	void ReadFrame(int frame, std::function<void (VideoFrame const&)> const& fn);
+
+	/// @brief Start decoding frames on the worker thread ahead of GetFrame
+	/// @param frames Frame numbers which are about to be requested
+	///
+	/// Pending frames are decoded in a forward sweep from the decoder's
+	/// current position so that each GOP is only decoded once regardless of
+	/// the order they were requested in, and at most a bounded number of them
+	/// are held in memory at once, so it's fine to pass every frame a script
+	/// is going to look at.
+	void Prefetch(std::vector<int> frames);
+
 	/// Ask the video provider to change YCbCr matricies
 	void SetColorSpace(std::string const& matrix);
 
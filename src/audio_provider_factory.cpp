@@ -0,0 +1,123 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#include "audio_provider_factory.h"
+
+#include "factory_manager.h"
+#include "options.h"
+
+#include <libaegisub/audio/provider.h>
+#include <libaegisub/fs.h>
+#include <libaegisub/log.h>
+#include <libaegisub/path.h>
+
+#include <boost/range/iterator_range.hpp>
+
+using namespace agi;
+
+std::unique_ptr<AudioProvider> CreateFFmpegSourceAudioProvider(fs::path const& filename, BackgroundRunner *);
+
+namespace {
+	struct factory {
+		const char *name;
+		std::unique_ptr<AudioProvider> (*create)(fs::path const&, BackgroundRunner *);
+		bool hidden;
+	};
+
+	const factory providers[] = {
+		{"Dummy", CreateDummyAudioProvider, true},
+		{"PCM", CreatePCMAudioProvider, true},
+#ifdef WITH_FFMS2
+		{"FFmpegSource", CreateFFmpegSourceAudioProvider, false},
+#endif
+	};
+}
+
+std::vector<std::string> AudioProviderFactory::GetClasses() {
+	return ::GetClasses(boost::make_iterator_range(std::begin(providers), std::end(providers)));
+}
+
+std::unique_ptr<AudioProvider> AudioProviderFactory::GetProvider(fs::path const& filename, Path const& path_helper, BackgroundRunner *br) {
+	auto preferred = OPT_GET("Audio/Provider")->GetString();
+	auto sorted = GetSorted(boost::make_iterator_range(std::begin(providers), std::end(providers)), preferred);
+
+	std::unique_ptr<AudioProvider> provider;
+	bool found_file = false;
+	bool found_audio = false;
+	std::string msg_all;     // error messages from all attempted providers
+	std::string msg_partial; // error messages from providers that could partially load the file (knows container, missing codec)
+
+	for (auto const& factory : sorted) {
+		try {
+			provider = factory->create(filename, br);
+			if (!provider) continue;
+			LOG_I("manager/audio/provider") << factory->name << ": opened " << filename;
+			break;
+		}
+		catch (fs::FileNotFound const& err) {
+			LOG_D("manager/audio/provider") << factory->name << ": " << err.GetMessage();
+		}
+		catch (AudioDataNotFound const& err) {
+			found_file = true;
+			msg_all += std::string(factory->name) + ": " + err.GetMessage() + "\n";
+		}
+		catch (AudioProviderError const& err) {
+			found_file = true;
+			found_audio = true;
+			std::string msg = std::string(factory->name) + ": " + err.GetMessage() + "\n";
+			msg_all += msg;
+			msg_partial += msg;
+		}
+	}
+
+	if (!provider) {
+		if (found_audio)
+			throw AudioProviderError(msg_partial);
+		if (found_file)
+			throw AudioDataNotFound(msg_all);
+		throw fs::FileNotFound(filename);
+	}
+
+	bool needs_cache = provider->NeedsCache();
+
+	// Everything downstream expects 16-bit mono samples
+	if (provider->GetBytesPerSample() != 2 || provider->AreSamplesFloat() || provider->GetSampleRate() < 32000 || provider->GetChannels() != 1)
+		provider = CreateConvertAudioProvider(std::move(provider));
+
+	// 0 = no cache, 1 = RAM, 2 = HD
+	int cache = OPT_GET("Audio/Cache/Type")->GetInt();
+	if (!cache || !needs_cache) {
+		if (provider->SupportsConcurrentReads())
+			return provider;
+		return CreateLockAudioProvider(std::move(provider));
+	}
+
+	// How long reads of audio which hasn't been cached yet wait for it
+	int wait_ms = OPT_GET("Audio/Cache/Wait")->GetInt();
+
+	if (cache == 1)
+		return CreateRAMAudioProvider(std::move(provider), wait_ms);
+
+	if (cache == 2) {
+		auto path = OPT_GET("Audio/Cache/HD/Location")->GetString();
+		if (path == "default")
+			path = "?temp";
+		auto cache_dir = path_helper.MakeAbsolute(path_helper.Decode(path), "?temp");
+		return CreateHDAudioProvider(std::move(provider), cache_dir, wait_ms);
+	}
+
+	throw InternalError("Invalid audio caching method");
+}
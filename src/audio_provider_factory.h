@@ -0,0 +1,39 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#include <libaegisub/fs_fwd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace agi {
+	class AudioProvider;
+	class BackgroundRunner;
+	class Path;
+}
+
+struct AudioProviderFactory {
+	static std::vector<std::string> GetClasses();
+
+	/// @brief Open an audio file and wrap it in the converters and cache
+	///        selected by the Audio/Cache options
+	/// @param filename File to open
+	/// @param path_helper Used to resolve the HD cache location
+	/// @param br Progress reporter for indexing
+	/// @return A provider of 16-bit mono samples
+	static std::unique_ptr<agi::AudioProvider> GetProvider(agi::fs::path const& filename, agi::Path const& path_helper, agi::BackgroundRunner *br);
+};
@@ -0,0 +1,222 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+/// @file audio_provider_ffmpegsource.cpp
+/// @brief FFmpegSource2-based audio provider
+/// @ingroup audio_input ffms
+///
+
+#ifdef WITH_FFMS2
+#include "ffmpegsource_common.h"
+
+#include "options.h"
+
+#include <libaegisub/audio/provider.h>
+#include <libaegisub/fs.h>
+#include <libaegisub/log.h>
+#include <libaegisub/make_unique.h>
+
+#include <map>
+#include <mutex>
+
+namespace {
+/// @class FFmpegSourceAudioProvider
+/// @brief Implements audio loading with the FFMS library.
+class FFmpegSourceAudioProvider final : public agi::AudioProvider, FFmpegSourceProvider {
+	/// index of the file, kept to open more audio sources from
+	agi::scoped_holder<FFMS_Index*, void (FFMS_CC *)(FFMS_Index*)> Index;
+	/// audio source object
+	agi::scoped_holder<FFMS_AudioSource*, void (FFMS_CC *)(FFMS_AudioSource*)> AudioSource;
+
+	agi::fs::path Filename;
+	int TrackNumber = -1;
+	/// How decoding errors were handled when the track was indexed
+	FFMS_IndexErrorHandling ErrorHandling = FFMS_IEH_STOP_TRACK;
+
+	/// FFMS audio sources can't be read from several threads at once, so each
+	/// concurrent reader gets its own. Sources which aren't in use wait here.
+	mutable std::vector<FFMS_AudioSource*> SpareSources;
+	/// Sources beyond the first which have been opened for concurrent reads
+	mutable std::vector<FFMS_AudioSource*> ExtraSources;
+	mutable std::mutex SourceMutex;
+
+	char FFMSErrMsg[1024];  ///< FFMS error message
+	FFMS_ErrorInfo ErrInfo; ///< FFMS error codes/messages
+
+	void LoadAudio(agi::fs::path const& filename);
+	FFMS_AudioSource *AcquireSource() const;
+	void ReleaseSource(FFMS_AudioSource *source) const;
+
+	void FillBuffer(void *Buf, int64_t Start, int64_t Count) const override {
+		char ErrMsg[1024];
+		FFMS_ErrorInfo Err;
+		Err.Buffer     = ErrMsg;
+		Err.BufferSize = sizeof(ErrMsg);
+		Err.ErrorType  = FFMS_ERROR_SUCCESS;
+		Err.SubType    = FFMS_ERROR_SUCCESS;
+
+		auto Source = AcquireSource();
+		int Failed = FFMS_GetAudio(Source, Buf, Start, Count, &Err);
+		ReleaseSource(Source);
+		if (Failed)
+			throw agi::AudioDecodeError(std::string("Failed to get audio samples: ") + ErrMsg);
+	}
+
+public:
+	FFmpegSourceAudioProvider(agi::fs::path const& filename, agi::BackgroundRunner *br);
+	~FFmpegSourceAudioProvider();
+
+	bool NeedsCache() const override { return true; }
+	bool SupportsConcurrentReads() const override { return true; }
+
+	std::string GetDecodeKey() const override {
+		return "FFmpegSource/" + std::to_string(TrackNumber) + "/" + std::to_string(ErrorHandling);
+	}
+};
+
+FFmpegSourceAudioProvider::FFmpegSourceAudioProvider(agi::fs::path const& filename, agi::BackgroundRunner *br) try
+: FFmpegSourceProvider(br)
+, Index(nullptr, FFMS_DestroyIndex)
+, AudioSource(nullptr, FFMS_DestroyAudioSource)
+{
+	ErrInfo.Buffer		= FFMSErrMsg;
+	ErrInfo.BufferSize	= sizeof(FFMSErrMsg);
+	ErrInfo.ErrorType	= FFMS_ERROR_SUCCESS;
+	ErrInfo.SubType		= FFMS_ERROR_SUCCESS;
+	SetLogLevel();
+
+	LoadAudio(filename);
+}
+catch (agi::EnvironmentError const& err) {
+	throw agi::AudioProviderError(err.GetMessage());
+}
+
+void FFmpegSourceAudioProvider::LoadAudio(agi::fs::path const& filename) {
+	FFMS_Indexer *Indexer = FFMS_CreateIndexer(filename.string().c_str(), &ErrInfo);
+	if (!Indexer) {
+		if (ErrInfo.SubType == FFMS_ERROR_FILE_READ)
+			throw agi::fs::FileNotFound(std::string(ErrInfo.Buffer));
+		else
+			throw agi::AudioDataNotFound(ErrInfo.Buffer);
+	}
+
+	std::map<int, std::string> TrackList = GetTracksOfType(Indexer, FFMS_TYPE_AUDIO);
+	if (TrackList.empty()) {
+		FFMS_CancelIndexing(Indexer);
+		throw agi::AudioDataNotFound("no audio tracks found");
+	}
+
+	// There's nobody to ask which track to use
+	if (TrackList.size() > 1)
+		LOG_W("agi/audio_provider_ffmpegsource") << "Multiple audio tracks in " << filename << "; defaulting to first track.";
+	TrackNumber = TrackList.begin()->first;
+	ErrorHandling = GetErrorHandlingMode();
+
+	// generate a name for the cache file
+	auto CacheName = GetCacheFilename(filename);
+
+	// try to read index
+	Index = FFMS_ReadIndex(CacheName.string().c_str(), &ErrInfo);
+
+	if (Index && FFMS_IndexBelongsToFile(Index, filename.string().c_str(), &ErrInfo))
+		Index = nullptr;
+
+	// the index may have been written by the video provider without the
+	// audio tracks, in which case it has to be redone
+	if (Index) {
+		FFMS_Track *TempTrackData = FFMS_GetTrackFromIndex(Index, TrackNumber);
+		if (FFMS_GetNumFrames(TempTrackData) <= 0)
+			Index = nullptr;
+	}
+
+	// moment of truth
+	if (!Index) {
+		auto TrackMask = static_cast<TrackSelection>(TrackNumber);
+		if (OPT_GET("Provider/FFmpegSource/Index All Tracks")->GetBool())
+			TrackMask = TrackSelection::All;
+		Index = DoIndexing(Indexer, CacheName, TrackMask, ErrorHandling);
+	}
+	else {
+		FFMS_CancelIndexing(Indexer);
+	}
+
+	// update access time of index file so it won't get cleaned away
+	agi::fs::Touch(CacheName);
+
+	AudioSource = FFMS_CreateAudioSource(filename.string().c_str(), TrackNumber, Index, FFMS_DELAY_FIRST_VIDEO_TRACK, &ErrInfo);
+	if (!AudioSource)
+		throw agi::AudioProviderError(std::string("Failed to open audio track: ") + ErrInfo.Buffer);
+	Filename = filename;
+	SpareSources.push_back(AudioSource);
+
+	const FFMS_AudioProperties AudioInfo = *FFMS_GetAudioProperties(AudioSource);
+
+	channels = AudioInfo.Channels;
+	sample_rate = AudioInfo.SampleRate;
+	num_samples = AudioInfo.NumSamples;
+	decoded_samples = AudioInfo.NumSamples;
+	if (channels <= 0 || sample_rate <= 0 || num_samples <= 0)
+		throw agi::AudioProviderError("Audio track has no samples");
+
+	switch (AudioInfo.SampleFormat) {
+		case FFMS_FMT_U8:  bytes_per_sample = 1; float_samples = false; break;
+		case FFMS_FMT_S16: bytes_per_sample = 2; float_samples = false; break;
+		case FFMS_FMT_S32: bytes_per_sample = 4; float_samples = false; break;
+		case FFMS_FMT_FLT: bytes_per_sample = 4; float_samples = true; break;
+		case FFMS_FMT_DBL: bytes_per_sample = 8; float_samples = true; break;
+		default:
+			throw agi::AudioProviderError("Unknown or unsupported sample format");
+	}
+}
+
+FFmpegSourceAudioProvider::~FFmpegSourceAudioProvider() {
+	for (auto source : ExtraSources)
+		FFMS_DestroyAudioSource(source);
+}
+
+FFMS_AudioSource *FFmpegSourceAudioProvider::AcquireSource() const {
+	std::lock_guard<std::mutex> lock(SourceMutex);
+	if (!SpareSources.empty()) {
+		auto source = SpareSources.back();
+		SpareSources.pop_back();
+		return source;
+	}
+
+	char ErrMsg[1024];
+	FFMS_ErrorInfo Err;
+	Err.Buffer     = ErrMsg;
+	Err.BufferSize = sizeof(ErrMsg);
+	Err.ErrorType  = FFMS_ERROR_SUCCESS;
+	Err.SubType    = FFMS_ERROR_SUCCESS;
+
+	auto source = FFMS_CreateAudioSource(Filename.string().c_str(), TrackNumber, Index, FFMS_DELAY_FIRST_VIDEO_TRACK, &Err);
+	if (!source)
+		throw agi::AudioDecodeError(std::string("Failed to open audio track: ") + ErrMsg);
+	ExtraSources.push_back(source);
+	return source;
+}
+
+void FFmpegSourceAudioProvider::ReleaseSource(FFMS_AudioSource *source) const {
+	std::lock_guard<std::mutex> lock(SourceMutex);
+	SpareSources.push_back(source);
+}
+}
+
+std::unique_ptr<agi::AudioProvider> CreateFFmpegSourceAudioProvider(agi::fs::path const& file, agi::BackgroundRunner *br) {
+	return agi::make_unique<FFmpegSourceAudioProvider>(file, br);
+}
+
+#endif /* WITH_FFMS2 */
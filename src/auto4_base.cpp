@@ -35,6 +35,7 @@
 #include "options.h"
 #include "string_codec.h"
 #include "subs_controller.h"
+#include "text_extents_freetype.h"
 
 #include <libaegisub/dispatch.h>
 #include <libaegisub/format.h>
@@ -46,7 +47,12 @@
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/functional/hash.hpp>
+#include <array>
 #include <future>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 #ifndef WIN32
 #include <wx/dcmemory.h>
@@ -59,14 +65,11 @@
 #include <libaegisub/charset_conv_win.h>
 #endif
 
-namespace Automation4 {
-	bool CalculateTextExtents(AssStyle *style, std::string const& text, double &width, double &height, double &descent, double &extlead)
+namespace {
+	/// Measure text with GDI on Windows and wx elsewhere, in 64ths of the
+	/// style's units
+	bool SystemTextExtents(AssStyle *style, std::string const& text, double fontsize, double spacing, double &width, double &height, double &descent, double &extlead)
 	{
-		width = height = descent = extlead = 0;
-
-		double fontsize = style->fontsize * 64;
-		double spacing = style->spacing * 64;
-
 #ifdef WIN32
 		// This is almost copypasta from TextSub
 		auto dc = CreateCompatibleDC(nullptr);
@@ -160,6 +163,104 @@ namespace Automation4 {
 		}
 #endif
 
+		return true;
+	}
+
+	/// The style fields which affect the metrics of text, plus the text
+	struct ExtentsKey {
+		std::string font;
+		double fontsize, scalex, scaley, spacing;
+		bool bold, italic, underline, strikeout;
+		int encoding;
+		bool freetype;
+		std::string text;
+
+		bool operator==(ExtentsKey const& o) const {
+			return text == o.text && font == o.font && fontsize == o.fontsize
+				&& scalex == o.scalex && scaley == o.scaley && spacing == o.spacing
+				&& bold == o.bold && italic == o.italic && underline == o.underline
+				&& strikeout == o.strikeout && encoding == o.encoding && freetype == o.freetype;
+		}
+	};
+
+	struct ExtentsKeyHash {
+		size_t operator()(ExtentsKey const& k) const {
+			size_t seed = std::hash<std::string>()(k.text);
+			boost::hash_combine(seed, k.font);
+			boost::hash_combine(seed, k.fontsize);
+			boost::hash_combine(seed, k.scalex);
+			boost::hash_combine(seed, k.scaley);
+			boost::hash_combine(seed, k.spacing);
+			boost::hash_combine(seed, k.encoding);
+			boost::hash_combine(seed, k.bold | k.italic << 1 | k.underline << 2 | k.strikeout << 3 | k.freetype << 4);
+			return seed;
+		}
+	};
+
+	/// Least recently used cache of measurements, as karaoke templates
+	/// measure the same syllables, spaces and characters over and over
+	class ExtentsCache {
+		using Extents = std::array<double, 4>;
+		using Entry = std::pair<ExtentsKey, Extents>;
+		static const size_t max_size = 8192;
+
+		std::mutex lock;
+		/// Most recently used first
+		std::list<Entry> entries;
+		std::unordered_map<ExtentsKey, std::list<Entry>::iterator, ExtentsKeyHash> index;
+		size_t hits = 0, misses = 0;
+
+		void Count(bool hit) {
+			++(hit ? hits : misses);
+			if ((hits + misses) % 100000 == 0)
+				LOG_D("automation/text_extents") << "cache: " << hits << " hits, " << misses << " misses";
+		}
+
+	public:
+		bool Get(ExtentsKey const& key, Extents &out) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = index.find(key);
+			Count(it != index.end());
+			if (it == index.end())
+				return false;
+			entries.splice(entries.begin(), entries, it->second);
+			out = it->second->second;
+			return true;
+		}
+
+		void Put(ExtentsKey const& key, Extents const& value) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (index.count(key)) return;
+			if (entries.size() >= max_size) {
+				index.erase(entries.back().first);
+				entries.pop_back();
+			}
+			entries.emplace_front(key, value);
+			index.emplace(key, entries.begin());
+		}
+	};
+
+	bool MeasureText(AssStyle *style, std::string const& text, bool freetype, double &width, double &height, double &descent, double &extlead)
+	{
+		double fontsize = style->fontsize * 64;
+		double spacing = style->spacing * 64;
+
+#ifdef WITH_HARFBUZZ
+		if (freetype) {
+			if (!Automation4::FreeTypeTextExtents(style->font, fontsize, style->bold, style->italic, spacing, text, width, height, descent, extlead))
+				return false;
+		}
+		else
+#endif
+		{
+			// wx's font and DC classes aren't thread-safe, and scripts can
+			// measure text from several threads at once with parallel_map
+			static std::mutex system_lock;
+			std::lock_guard<std::mutex> guard(system_lock);
+			if (!SystemTextExtents(style, text, fontsize, spacing, width, height, descent, extlead))
+				return false;
+		}
+
 		// Compensate for scaling
 		width = style->scalex / 100 * width / 64;
 		height = style->scaley / 100 * height / 64;
@@ -168,6 +269,32 @@ namespace Automation4 {
 
 		return true;
 	}
+}
+
+namespace Automation4 {
+	bool CalculateTextExtents(AssStyle *style, std::string const& text, double &width, double &height, double &descent, double &extlead)
+	{
+		width = height = descent = extlead = 0;
+
+		static ExtentsCache cache;
+		ExtentsKey key{style->font, style->fontsize, style->scalex, style->scaley, style->spacing,
+			style->bold, style->italic, style->underline, style->strikeout, style->encoding,
+			OPT_GET("Automation/Text Extents")->GetString() == "freetype", text};
+
+		std::array<double, 4> extents;
+		if (cache.Get(key, extents)) {
+			width = extents[0];
+			height = extents[1];
+			descent = extents[2];
+			extlead = extents[3];
+			return true;
+		}
+
+		if (!MeasureText(style, text, key.freetype, width, height, descent, extlead))
+			return false;
+		cache.Put(key, {{width, height, descent, extlead}});
+		return true;
+	}
 
 	// Script
 	Script::Script(agi::fs::path const& filename)
@@ -45,11 +45,14 @@
 #include "include/aegisub/context.h"
 #include "options.h"
 #include "project.h"
+#include "resolution_resampler.h"
 #include "selection_controller.h"
 #include "subs_controller.h"
 #include "video_controller.h"
 #include "utils.h"
 
+#include <libaegisub/audio/envelope.h>
+#include <libaegisub/audio/provider.h>
 #include <libaegisub/dispatch.h>
 #include <libaegisub/format.h>
 #include <libaegisub/log.h>
@@ -67,6 +70,7 @@
 #include <boost/scope_exit.hpp>
 #include <cassert>
 #include <mutex>
+#include <thread>
 
 using namespace agi::lua;
 using namespace Automation4;
@@ -102,6 +106,24 @@ namespace {
 		return c;
 	}
 
+	bool is_parallel_worker(lua_State *L)
+	{
+		lua_getfield(L, LUA_REGISTRYINDEX, "parallel_worker");
+		bool worker = !!lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		return worker;
+	}
+
+	/// Wrap an API function which reads from the project's video or audio
+	/// providers, which must not be used from parallel_map's worker threads
+	template<int (*func)(lua_State *L)>
+	int main_state_only(lua_State *L)
+	{
+		if (is_parallel_worker(L))
+			error(L, "This function cannot be used from a function run by parallel_map");
+		return func(L);
+	}
+
 	int get_file_name(lua_State *L)
 	{
 		const agi::Context *c = get_context(L);
@@ -166,6 +188,90 @@ namespace {
 		return 1;
 	}
 
+	agi::vfr::Time check_time_type(lua_State *L, int idx)
+	{
+		if (lua_isnoneornil(L, idx))
+			return agi::vfr::START;
+		std::string type = check_string(L, idx);
+		if (type == "start") return agi::vfr::START;
+		if (type == "end") return agi::vfr::END;
+		if (type == "exact") return agi::vfr::EXACT;
+		error(L, "unknown time type '%s'", type.c_str());
+		return agi::vfr::START;
+	}
+
+	/// Convert an array of times to frames or the reverse in a single call,
+	/// so that scripts snapping every line don't pay for a Lua to C
+	/// transition and a segment search per value
+	template<void (agi::vfr::Framerate::*convert)(const int *, size_t, int *, agi::vfr::Time) const>
+	int convert_array(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		argcheck(L, !!lua_istable(L, 1), 1, "table expected");
+		auto type = check_time_type(L, 2);
+		if (!c || !c->project->Timecodes().IsLoaded()) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		int count = (int)lua_objlen(L, 1);
+		std::vector<int> values(count);
+		for (int i = 0; i < count; ++i) {
+			lua_rawgeti(L, 1, i + 1);
+			if (!lua_isnumber(L, -1))
+				error(L, "bad argument #1 (element %d is not a number)", i + 1);
+			values[i] = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+
+		(c->project->Timecodes().*convert)(values.data(), values.size(), values.data(), type);
+
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; ++i) {
+			push_value(L, values[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	int ffi_frames_from_ms(const void *fps, const int *ms, unsigned long count, int *out, int type)
+	{
+		auto const& timecodes = *static_cast<const agi::vfr::Framerate *>(fps);
+		if (!timecodes.IsLoaded()) return 0;
+		timecodes.FramesAtTimes(ms, count, out, static_cast<agi::vfr::Time>(type));
+		return 1;
+	}
+
+	int ffi_ms_from_frames(const void *fps, const int *frames, unsigned long count, int *out, int type)
+	{
+		auto const& timecodes = *static_cast<const agi::vfr::Framerate *>(fps);
+		if (!timecodes.IsLoaded()) return 0;
+		timecodes.TimesAtFrames(frames, count, out, static_cast<agi::vfr::Time>(type));
+		return 1;
+	}
+
+	/// Push the timecodes of the current context, or nil if there is none.
+	/// This has to be looked up on each conversion, as modules are usually
+	/// required before the script has been given a context.
+	int current_timecodes(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		if (c)
+			push_value(L, (void *)&c->project->Timecodes());
+		else
+			lua_pushnil(L);
+		return 1;
+	}
+
+	int timecodes_init(lua_State *L)
+	{
+		agi::lua::register_lib_table(L, {},
+			"frames_from_ms", ffi_frames_from_ms,
+			"ms_from_frames", ffi_ms_from_frames);
+		lua_pushcfunction(L, exception_wrapper<current_timecodes>);
+		return 2;
+	}
+
 	int video_size(lua_State *L)
 	{
 		const agi::Context *c = get_context(L);
@@ -183,6 +289,67 @@ namespace {
 		}
 	}
 
+	int get_frame(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		if (!c || !c->project->VideoProvider()) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		auto provider = c->project->VideoProvider();
+		int n = check_int(L, 1);
+		argcheck(L, n >= 0 && n < provider->GetFrameCount(), 1, "frame number out of range");
+		PushVideoFrame(L, provider->GetFrame(n));
+		return 1;
+	}
+
+	int read_frame(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		if (!c || !c->project->VideoProvider())
+			return 0;
+
+		auto provider = c->project->VideoProvider();
+		int n = check_int(L, 1);
+		argcheck(L, n >= 0 && n < provider->GetFrameCount(), 1, "frame number out of range");
+		argcheck(L, !!lua_isfunction(L, 2), 2, "function expected");
+		lua_settop(L, 2);
+
+		bool failed = false;
+		provider->ReadFrame(n, [&](VideoFrame const& frame) {
+			// The frame belongs to the provider, so hand lua a non-owning
+			// reference and revoke it once the callback returns
+			PushVideoFrame(L, std::shared_ptr<VideoFrame>(const_cast<VideoFrame *>(&frame), [](VideoFrame *) { }));
+			lua_pushvalue(L, 2);
+			lua_pushvalue(L, 3);
+			failed = !!lua_pcall(L, 1, LUA_MULTRET, 0);
+			ReleaseVideoFrame(L, 3);
+		});
+
+		if (failed)
+			return lua_error(L);
+		return lua_gettop(L) - 3;
+	}
+
+	int prefetch_frames(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		argcheck(L, !!lua_istable(L, 1), 1, "table expected");
+		if (!c || !c->project->VideoProvider())
+			return 0;
+
+		std::vector<int> frames;
+		frames.reserve(lua_objlen(L, 1));
+		lua_pushvalue(L, 1);
+		lua_for_each(L, [&] {
+			if (lua_isnumber(L, -1))
+				frames.push_back(lua_tointeger(L, -1));
+		});
+		c->project->VideoProvider()->Prefetch(std::move(frames));
+		return 0;
+	}
+
 	int get_keyframes(lua_State *L)
 	{
 		if (const agi::Context *c = get_context(L))
@@ -213,26 +380,10 @@ namespace {
 	{
 		argcheck(L, !!lua_istable(L, 1), 1, "");
 		argcheck(L, !!lua_isstring(L, 2), 2, "");
-
-		// have to check that it looks like a style table before actually converting
-		// if it's a dialogue table then an active AssFile object is required
-		{
-			lua_getfield(L, 1, "class");
-			std::string actual_class{lua_tostring(L, -1)};
-			boost::to_lower(actual_class);
-			if (actual_class != "style")
-				return error(L, "Not a style entry");
-			lua_pop(L, 1);
-		}
-
-		lua_pushvalue(L, 1);
-		std::unique_ptr<AssEntry> et(Automation4::LuaAssFile::LuaToAssEntry(L));
-		lua_pop(L, 1);
-		if (typeid(*et) != typeid(AssStyle))
-			return error(L, "Not a style entry");
+		auto style = Automation4::LuaToAssStyle(L, 1);
 
 		double width, height, descent, extlead;
-		if (!Automation4::CalculateTextExtents(static_cast<AssStyle*>(et.get()),
+		if (!Automation4::CalculateTextExtents(style.get(),
 				check_string(L, 2), width, height, descent, extlead))
 			return error(L, "Some internal error occurred calculating text_extents");
 
@@ -243,13 +394,197 @@ namespace {
 		return 4;
 	}
 
+	/// Measure an array of strings with one style, converting the style only
+	/// once. Returns arrays of the widths, heights, descents and external
+	/// leadings.
+	int lua_text_extents_many(lua_State *L)
+	{
+		argcheck(L, !!lua_istable(L, 1), 1, "");
+		argcheck(L, !!lua_istable(L, 2), 2, "");
+		auto style = Automation4::LuaToAssStyle(L, 1);
+
+		int count = static_cast<int>(lua_objlen(L, 2));
+		for (int i = 0; i < 4; ++i)
+			lua_createtable(L, count, 0);
+		int results = lua_gettop(L) - 3;
+
+		for (int i = 1; i <= count; ++i) {
+			lua_rawgeti(L, 2, i);
+			if (!lua_isstring(L, -1))
+				return error(L, "text_extents_many: item %d is not a string", i);
+			size_t len;
+			const char *str = lua_tolstring(L, -1, &len);
+			std::string text(str, len);
+			lua_pop(L, 1);
+
+			double extents[4];
+			if (!Automation4::CalculateTextExtents(style.get(), text, extents[0], extents[1], extents[2], extents[3]))
+				return error(L, "Some internal error occurred calculating text_extents");
+			for (int j = 0; j < 4; ++j) {
+				lua_pushnumber(L, extents[j]);
+				lua_rawseti(L, results + j, i);
+			}
+		}
+		return 4;
+	}
+
+	/// Number of chunks cached_loadstring keeps before starting over, so that
+	/// sources which are generated per line can't grow the cache forever
+	const int loadstring_cache_limit = 16384;
+
+	/// loadstring(source[, chunkname[, env]]) which returns the same function
+	/// for repeated calls with the same source, so that code evaluated once
+	/// per syllable only has to be compiled once. The chunk name of the first
+	/// call is the one used for error messages. As the function is shared,
+	/// callers must set its environment before each run, which passing env
+	/// does.
+	int lua_cached_loadstring(lua_State *L)
+	{
+		std::string source = check_string(L, 1);
+		std::string chunkname = lua_isnoneornil(L, 2) ? source : check_string(L, 2);
+		bool has_env = !lua_isnoneornil(L, 3);
+		if (has_env)
+			argcheck(L, !!lua_istable(L, 3), 3, "table expected");
+		lua_settop(L, 3);
+
+		lua_getfield(L, LUA_REGISTRYINDEX, "loadstring_cache");
+		if (!lua_istable(L, -1) || lua_objlen(L, -1) >= (size_t)loadstring_cache_limit) {
+			lua_pop(L, 1);
+			lua_newtable(L);
+			lua_pushvalue(L, -1);
+			lua_setfield(L, LUA_REGISTRYINDEX, "loadstring_cache");
+		}
+		int cache = lua_gettop(L);
+
+		// The array part of the cache counts the entries so that it can be
+		// bounded; sources are always strings so the keys can't collide
+		lua_pushvalue(L, 1);
+		lua_rawget(L, cache);
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			if (luaL_loadbuffer(L, source.data(), source.size(), chunkname.c_str())) {
+				lua_pushnil(L);
+				lua_insert(L, -2);
+				return 2;
+			}
+			lua_pushvalue(L, 1);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, cache);
+			lua_pushboolean(L, true);
+			lua_rawseti(L, cache, lua_objlen(L, cache) + 1);
+		}
+
+		if (has_env) {
+			lua_pushvalue(L, 3);
+			lua_setfenv(L, -2);
+		}
+		return 1;
+	}
+
+	/// transform_drawing(drawing[, scale_x[, scale_y[, offset_x[, offset_y]]]])
+	int lua_transform_drawing(lua_State *L)
+	{
+		auto drawing = check_string(L, 1);
+		double scale_x = luaL_optnumber(L, 2, 1);
+		double scale_y = luaL_optnumber(L, 3, 1);
+		double offset_x = luaL_optnumber(L, 4, 0);
+		double offset_y = luaL_optnumber(L, 5, 0);
+		push_value(L, TransformDrawing(drawing, offset_x, offset_y, scale_x, scale_y));
+		return 1;
+	}
+
 	int lua_get_audio_selection(lua_State *L)
 	{
-		push_value(L, 0);
-		push_value(L, 0);
+		// With no audio display, the selection is the active line as it is
+		// in the GUI's default dialogue timing mode
+		const agi::Context *c = get_context(L);
+		AssDialogue *line = c && c->project->AudioProvider() ? c->selectionController->GetActiveLine() : nullptr;
+		push_value(L, line ? static_cast<int>(line->Start) : 0);
+		push_value(L, line ? static_cast<int>(line->End) : 0);
 		return 2;
 	}
 
+	int get_audio_properties(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		auto provider = c ? c->project->AudioProvider() : nullptr;
+		if (!provider) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		lua_createtable(L, 0, 4);
+		set_field(L, "sample_rate", provider->GetSampleRate());
+		set_field(L, "num_samples", provider->GetNumSamples());
+		set_field(L, "channels", provider->GetChannels());
+		set_field(L, "file", c->project->AudioName());
+		return 1;
+	}
+
+	int get_audio(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		auto provider = c ? c->project->AudioProvider() : nullptr;
+		if (!provider) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		auto start = static_cast<int64_t>(luaL_checknumber(L, 1));
+		auto count = static_cast<int64_t>(luaL_checknumber(L, 2));
+		argcheck(L, start >= 0, 1, "start must not be negative");
+		argcheck(L, count >= 0, 2, "count must not be negative");
+
+		// Clamp before allocating so that a huge count from a script can't
+		// ask for more memory than the audio could ever fill
+		count = std::min(count, std::max<int64_t>(0, provider->GetNumSamples() - start));
+
+		// The provider chain always produces 16-bit mono
+		std::vector<int16_t> buf(static_cast<size_t>(count));
+		provider->GetAudio(buf.data(), start, count);
+		lua_pushlstring(L, reinterpret_cast<const char *>(buf.data()), buf.size() * sizeof(int16_t));
+		return 1;
+	}
+
+	int get_audio_envelope(lua_State *L)
+	{
+		const agi::Context *c = get_context(L);
+		auto envelope = c ? c->project->AudioEnvelope() : nullptr;
+		if (!envelope) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		int start_ms = check_int(L, 1);
+		int end_ms = check_int(L, 2);
+		int resolution = lua_isnoneornil(L, 3) ? 10 : check_int(L, 3);
+		argcheck(L, start_ms >= 0, 1, "start must not be negative");
+		argcheck(L, end_ms >= start_ms, 2, "end must not be before start");
+		argcheck(L, resolution > 0, 3, "resolution must be positive");
+
+		auto to_sample = [&](int64_t ms) { return ms * envelope->GetSampleRate() / 1000; };
+		int count = (end_ms - start_ms + resolution - 1) / resolution;
+
+		lua_createtable(L, 0, 3);
+		lua_createtable(L, count, 0);
+		lua_createtable(L, count, 0);
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; ++i) {
+			int64_t ms = start_ms + (int64_t)i * resolution;
+			auto point = envelope->Summarise(to_sample(ms), to_sample(std::min<int64_t>(ms + resolution, end_ms)));
+			push_value(L, point.min / 32768.0);
+			lua_rawseti(L, -4, i + 1);
+			push_value(L, point.max / 32768.0);
+			lua_rawseti(L, -3, i + 1);
+			push_value(L, point.rms / 32768.0);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -4, "rms");
+		lua_setfield(L, -3, "max");
+		lua_setfield(L, -2, "min");
+		return 1;
+	}
+
 	int lua_set_status_text(lua_State *L)
 	{
 		const agi::Context *c = get_context(L);
@@ -346,12 +681,24 @@ namespace {
 
 		std::vector<cmd::Command*> macros;
 
+		/// Copies of the script which aegisub.parallel_map spreads work over,
+		/// created the first time it is called
+		std::vector<lua_State *> workers;
+
 		/// load script and create internal structures etc.
 		void Create();
 		/// destroy internal structures, unreg features and delete environment
 		void Destroy();
 
+		/// Register the aegisub API in a new lua state and run the script in it
+		/// @param L State to set up
+		/// @param worker Is this a parallel_map worker rather than the script's own state?
+		/// @param[out] err Description of what went wrong if the script failed to load
+		/// @return Did the script load successfully?
+		bool LoadState(lua_State *L, bool worker, std::string &err);
+
 		static int LuaInclude(lua_State *L);
+		static int LuaParallelMap(lua_State *L);
 
 	public:
 		LuaScript(agi::fs::path const& filename);
@@ -397,6 +744,34 @@ namespace {
 		BOOST_SCOPE_EXIT_ALL(&) { if (!loaded) Destroy(); };
 		LuaStackcheck stackcheck(L);
 
+		if (!LoadState(L, false, description))
+			return;
+		stackcheck.check_stack(0);
+
+		lua_getglobal(L, "version");
+		if (lua_isnumber(L, -1) && lua_tointeger(L, -1) == 3) {
+			lua_pop(L, 1); // just to avoid tripping the stackcheck in debug
+			description = "Attempted to load an Automation 3 script as an Automation 4 Lua script. Automation 3 is no longer supported.";
+			return;
+		}
+
+		name = get_global_string(L, "script_name");
+		description = get_global_string(L, "script_description");
+		author = get_global_string(L, "script_author");
+		version = get_global_string(L, "script_version");
+
+		if (name.empty())
+			name = GetPrettyFilename().string();
+
+		lua_pop(L, 1);
+		// if we got this far, the script should be ready
+		loaded = true;
+	}
+
+	bool LuaScript::LoadState(lua_State *L, bool worker, std::string &err)
+	{
+		LuaStackcheck stackcheck(L);
+
 		// register standard libs
 		preload_modules(L);
 		stackcheck.check_stack(0);
@@ -412,9 +787,9 @@ namespace {
 		// Replace the default lua module loader with our unicode compatible
 		// one and set the module search path
 		if (!Install(L, include_path)) {
-			description = get_string_or_default(L, 1);
+			err = get_string_or_default(L, 1);
 			lua_pop(L, 1);
-			return;
+			return false;
 		}
 		stackcheck.check_stack(0);
 
@@ -430,26 +805,52 @@ namespace {
 		lua_setfield(L, LUA_REGISTRYINDEX, "aegisub");
 		stackcheck.check_stack(0);
 
+		// workers only run the functions handed to parallel_map, so they must
+		// not register macros of their own or touch the providers
+		if (worker) {
+			lua_pushboolean(L, 1);
+			lua_setfield(L, LUA_REGISTRYINDEX, "parallel_worker");
+		}
+
 		// make "aegisub" table
 		lua_pushstring(L, "aegisub");
-		lua_createtable(L, 0, 13);
+		lua_createtable(L, 0, 31);
 
-		set_field<LuaCommand::LuaRegister>(L, "register_macro");
+		if (worker)
+			set_field<register_filter_noop>(L, "register_macro");
+		else
+			set_field<LuaCommand::LuaRegister>(L, "register_macro");
 		set_field<register_filter_noop>(L, "register_filter");
 		set_field<lua_text_textents>(L, "text_extents");
+		set_field<lua_text_extents_many>(L, "text_extents_many");
+		set_field<LuaKaraskelPreproc>(L, "karaskel_preproc");
+		set_field<lua_cached_loadstring>(L, "cached_loadstring");
+		set_field<lua_transform_drawing>(L, "transform_drawing");
+		set_field<LuaParseTags>(L, "parse_tags");
+		set_field<LuaUnparseTags>(L, "unparse_tags");
 		set_field<frame_from_ms>(L, "frame_from_ms");
 		set_field<ms_from_frame>(L, "ms_from_frame");
+		set_field<convert_array<&agi::vfr::Framerate::FramesAtTimes>>(L, "frames_from_ms");
+		set_field<convert_array<&agi::vfr::Framerate::TimesAtFrames>>(L, "ms_from_frames");
 		set_field<video_size>(L, "video_size");
+		set_field<main_state_only<get_frame>>(L, "get_frame");
+		set_field<main_state_only<read_frame>>(L, "read_frame");
+		set_field<main_state_only<prefetch_frames>>(L, "prefetch_frames");
 		set_field<get_keyframes>(L, "keyframes");
 		set_field<decode_path>(L, "decode_path");
 		set_field<cancel_script>(L, "cancel");
 		set_field(L, "lua_automation_version", 4);
 		set_field<clipboard_init>(L, "__init_clipboard");
+		set_field<timecodes_init>(L, "__init_timecodes");
 		set_field<get_file_name>(L, "file_name");
 		set_field<get_translation>(L, "gettext");
 		set_field<project_properties>(L, "project_properties");
 		set_field<lua_get_audio_selection>(L, "get_audio_selection");
+		set_field<get_audio_properties>(L, "audio_properties");
+		set_field<main_state_only<get_audio>>(L, "get_audio");
+		set_field<main_state_only<get_audio_envelope>>(L, "audio_envelope");
 		set_field<lua_set_status_text>(L, "set_status_text");
+		set_field<LuaParallelMap>(L, "parallel_map");
 
 		// store aegisub table to globals
 		lua_settable(L, LUA_GLOBALSINDEX);
@@ -457,9 +858,9 @@ namespace {
 
 		// load user script
 		if (!LoadFile(L, GetFilename())) {
-			description = get_string_or_default(L, 1);
+			err = get_string_or_default(L, 1);
 			lua_pop(L, 1);
-			return;
+			return false;
 		}
 		stackcheck.check_stack(1);
 
@@ -471,31 +872,13 @@ namespace {
 		// this is where features are registered
 		if (lua_pcall(L, 0, 0, -2)) {
 			// error occurred, assumed to be on top of Lua stack
-			description = agi::format("Error initialising Lua script \"%s\":\n\n%s", GetPrettyFilename().string(), get_string_or_default(L, -1));
+			err = agi::format("Error initialising Lua script \"%s\":\n\n%s", GetPrettyFilename().string(), get_string_or_default(L, -1));
 			lua_pop(L, 2); // error + error handler
-			return;
+			return false;
 		}
 		lua_pop(L, 1); // error handler
 		stackcheck.check_stack(0);
-
-		lua_getglobal(L, "version");
-		if (lua_isnumber(L, -1) && lua_tointeger(L, -1) == 3) {
-			lua_pop(L, 1); // just to avoid tripping the stackcheck in debug
-			description = "Attempted to load an Automation 3 script as an Automation 4 Lua script. Automation 3 is no longer supported.";
-			return;
-		}
-
-		name = get_global_string(L, "script_name");
-		description = get_global_string(L, "script_description");
-		author = get_global_string(L, "script_author");
-		version = get_global_string(L, "script_version");
-
-		if (name.empty())
-			name = GetPrettyFilename().string();
-
-		lua_pop(L, 1);
-		// if we got this far, the script should be ready
-		loaded = true;
+		return true;
 	}
 
 	void LuaScript::Destroy()
@@ -508,6 +891,10 @@ namespace {
 		for (int i = macros.size() - 1; i >= 0; --i)
 			cmd::unreg(macros[i]->name());
 
+		for (auto worker : workers)
+			lua_close(worker);
+		workers.clear();
+
 		lua_close(L);
 		L = nullptr;
 	}
@@ -566,6 +953,41 @@ namespace {
 		return lua_gettop(L) - pretop;
 	}
 
+	int LuaScript::LuaParallelMap(lua_State *L)
+	{
+		// Calls made from inside a worker just run in that worker
+		if (is_parallel_worker(L))
+			return RunParallelMap(L, {});
+
+		LuaScript *s = GetScriptObject(L);
+		if (s->workers.empty()) {
+			int count = OPT_GET("Automation/Parallel Workers")->GetInt();
+			if (count <= 0)
+				count = std::max(1u, std::thread::hardware_concurrency());
+			if (count == 1)
+				return RunParallelMap(L, {});
+
+			for (int i = 0; i < count; ++i) {
+				lua_State *worker = luaL_newstate();
+				std::string err = "Could not initialize Lua state";
+				if (!worker || !s->LoadState(worker, true, err)) {
+					if (worker)
+						lua_close(worker);
+					for (auto w : s->workers)
+						lua_close(w);
+					s->workers.clear();
+					return error(L, "Could not load a copy of the script for parallel_map: %s", err.c_str());
+				}
+				s->workers.push_back(worker);
+			}
+		}
+
+		const agi::Context *c = get_context(L);
+		for (auto worker : s->workers)
+			set_context(worker, c);
+		return RunParallelMap(L, s->workers);
+	}
+
 	void LuaThreadedCall(lua_State *L, int nargs, int nresults, std::string const& title, bool can_open_config)
 	{
 		bool failed = false;
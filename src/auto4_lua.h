@@ -33,7 +33,9 @@
 #include <vector>
 
 class AssEntry;
+class AssStyle;
 struct lua_State;
+struct VideoFrame;
 
 namespace Automation4 {
 	/// @class LuaAssFile
@@ -208,4 +210,46 @@ namespace Automation4 {
 		std::string Serialise() override;
 		void Unserialise(const std::string &serialised) override;
 	};
+
+	/// Push a userdata wrapping a decoded video frame onto the lua stack
+	/// @param L Lua state
+	/// @param frame Frame to wrap; the userdata holds a reference to it until
+	///              it is garbage collected
+	void PushVideoFrame(lua_State *L, std::shared_ptr<VideoFrame> frame);
+
+	/// Drop the reference to the frame held by a video frame userdata, so
+	/// that any further use of it from lua raises an error
+	/// @param L Lua state
+	/// @param idx Stack index of the userdata
+	void ReleaseVideoFrame(lua_State *L, int idx);
+
+	/// Convert the style table at the given stack index to an AssStyle,
+	/// raising a lua error if it is not a style table
+	std::unique_ptr<AssStyle> LuaToAssStyle(lua_State *L, int idx);
+
+	/// Native equivalent of karaskel.preproc_line_pos for a line which has not
+	/// been preprocessed yet, exposed as aegisub.karaskel_preproc(meta, styles, line)
+	/// @param L Lua state with the meta, styles and line tables at indices 1-3
+	/// @return 0; the line table is modified in place
+	int LuaKaraskelPreproc(lua_State *L);
+
+	/// Implementation of aegisub.parse_tags(text), which splits the text of a
+	/// line into blocks with the override tags and their parameters parsed
+	/// @param L Lua state with the text at index 1
+	/// @return 1; the array of blocks
+	int LuaParseTags(lua_State *L);
+
+	/// Implementation of aegisub.unparse_tags(blocks), the inverse of
+	/// aegisub.parse_tags
+	/// @param L Lua state with the array of blocks at index 1
+	/// @return 1; the line text
+	int LuaUnparseTags(lua_State *L);
+
+	/// Implementation of aegisub.parallel_map(fn, items, shared), which calls
+	/// fn(item, shared) for each item and returns an array of the results
+	/// @param L Lua state with the arguments at indices 1-3
+	/// @param workers Copies of the calling script to spread the items over.
+	///                If empty, the items are processed in the calling state.
+	/// @return 1; the array of results is on top of the stack
+	int RunParallelMap(lua_State *L, std::vector<lua_State *> const& workers);
 }
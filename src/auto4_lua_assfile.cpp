@@ -327,6 +327,32 @@ namespace Automation4 {
 		return result;
 	}
 
+	std::unique_ptr<AssStyle> LuaToAssStyle(lua_State *L, int idx)
+	{
+		if (idx < 0)
+			idx = lua_gettop(L) + idx + 1;
+		if (!lua_istable(L, idx))
+			error(L, "Not a style entry");
+
+		// have to check that it looks like a style table before actually converting
+		// if it's a dialogue table then an active AssFile object is required
+		{
+			lua_getfield(L, idx, "class");
+			std::string actual_class{get_string_or_default(L, -1)};
+			boost::to_lower(actual_class);
+			if (actual_class != "style")
+				error(L, "Not a style entry");
+			lua_pop(L, 1);
+		}
+
+		lua_pushvalue(L, idx);
+		std::unique_ptr<AssEntry> et(LuaAssFile::LuaToAssEntry(L));
+		lua_pop(L, 1);
+		if (typeid(*et) != typeid(AssStyle))
+			error(L, "Not a style entry");
+		return std::unique_ptr<AssStyle>(static_cast<AssStyle*>(et.release()));
+	}
+
 	int LuaAssFile::ObjectIndexRead(lua_State *L)
 	{
 		switch (lua_type(L, 2)) {
@@ -0,0 +1,692 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+/// @file auto4_lua_karaskel.cpp
+/// @brief Native implementation of karaskel's line preprocessing
+/// @ingroup scripting
+///
+/// This mirrors karaskel.preproc_line_text, preproc_line_size and
+/// preproc_line_pos from karaskel-auto4.lua and must produce exactly the same
+/// tables, so any change to either has to be made to both.
+
+#include "auto4_lua.h"
+
+#include "ass_dialogue.h"
+#include "ass_karaoke.h"
+#include "ass_style.h"
+
+#include <libaegisub/lua/utils.h>
+
+#include <algorithm>
+
+namespace {
+	using namespace agi::lua;
+
+	struct Highlight {
+		int start_time;
+		int end_time;
+		int duration;
+	};
+
+	struct Furigana {
+		std::string text;
+		std::string tag;
+		std::string inline_fx;
+		int start_time;
+		int end_time;
+		int duration;
+		double kdur;
+		bool isbreak;
+		bool spillback;
+		size_t syl;       ///< Index of the output syllable this belongs to
+		size_t highlight; ///< Index of the shared highlight table
+		double width = 0, height = 0;
+		double left = 0, center = 0, right = 0;
+	};
+
+	/// An output syllable, possibly made of several highlights
+	struct Syllable {
+		std::string text;
+		std::string tag;
+		std::string text_stripped;
+		std::string inline_fx;
+		std::string text_spacestripped;
+		std::string prespace;
+		std::string postspace;
+		bool has_text = false;
+		int duration = 0;
+		double kdur = 0;
+		int start_time = 0;
+		int end_time = 0;
+		std::vector<size_t> highlights;
+		std::vector<size_t> furi;
+		double width = 0, height = 0;
+		double prespacewidth = 0, postspacewidth = 0;
+		double left = 0, center = 0, right = 0;
+	};
+
+	struct LayoutGroup {
+		double basewidth = 0;
+		double furiwidth = 0;
+		std::vector<size_t> syls;
+		std::vector<size_t> furi;
+		bool spillback = false;
+		double left = 0, right = 0;
+		/// karaskel distinguishes a nil rightspill from a zero one
+		bool has_rightspill = false;
+		double rightspill = 0;
+	};
+
+	/// The first character of a string, using unicode.charwidth's rules
+	std::string first_char(std::string const& str)
+	{
+		if (str.empty()) return str;
+		unsigned char b = str[0];
+		return str.substr(0, b < 128 ? 1 : b < 224 ? 2 : b < 240 ? 3 : 4);
+	}
+
+	/// Equivalent of text:match("%{.*\\%-([^}\\]+)")
+	bool find_inline_fx(std::string const& text, std::string& fx)
+	{
+		size_t brace = text.find('{');
+		if (brace == std::string::npos) return false;
+		for (size_t i = text.size(); i-- > brace + 1; ) {
+			if (text[i] != '\\' || i + 2 >= text.size() || text[i + 1] != '-')
+				continue;
+			if (text[i + 2] == '}' || text[i + 2] == '\\')
+				continue;
+			size_t end = text.find_first_of("}\\", i + 2);
+			fx = text.substr(i + 2, end == std::string::npos ? end : end - i - 2);
+			return true;
+		}
+		return false;
+	}
+
+	void replace_all(std::string& str, std::string const& from, std::string const& to)
+	{
+		for (size_t pos = 0; (pos = str.find(from, pos)) != std::string::npos; pos += to.size())
+			str.replace(pos, from.size(), to);
+	}
+
+	bool is_multi_hl(std::string const& prefix)
+	{
+		return prefix == "#" || prefix == "\xEF\xBC\x83";
+	}
+
+	std::string get_string(lua_State *L, int table, const char *name)
+	{
+		lua_getfield(L, table, name);
+		if (!lua_isstring(L, -1))
+			error(L, "karaskel_preproc: field '%s' must be a string", name);
+		std::string ret(lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return ret;
+	}
+
+	int get_int(lua_State *L, int table, const char *name)
+	{
+		lua_getfield(L, table, name);
+		if (!lua_isnumber(L, -1))
+			error(L, "karaskel_preproc: field '%s' must be a number", name);
+		int ret = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		return ret;
+	}
+
+	double get_number(lua_State *L, int table, const char *name)
+	{
+		lua_getfield(L, table, name);
+		if (!lua_isnumber(L, -1))
+			error(L, "karaskel_preproc: field '%s' must be a number", name);
+		double ret = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		return ret;
+	}
+
+	/// Call aegisub.debug.out(level, fmt[, arg]) if it exists
+	void debug_out(lua_State *L, int level, std::string const& fmt, const char *arg = nullptr)
+	{
+		lua_getglobal(L, "aegisub");
+		if (lua_istable(L, -1)) {
+			lua_getfield(L, -1, "debug");
+			if (lua_istable(L, -1)) {
+				lua_getfield(L, -1, "out");
+				if (lua_isfunction(L, -1)) {
+					push_value(L, level);
+					push_value(L, fmt);
+					if (arg) push_value(L, arg);
+					lua_call(L, arg ? 3 : 2, 0);
+				}
+				else
+					lua_pop(L, 1);
+			}
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 1);
+	}
+
+	/// Set line[name] to its own value if that is positive, and to the style's
+	/// value (whatever that is) otherwise
+	void set_eff_margin(lua_State *L, int line, int style, const char *name, const char *eff_name)
+	{
+		double value = get_number(L, line, name);
+		if (value > 0)
+			lua_getfield(L, line, name);
+		else
+			lua_getfield(L, style, name);
+		lua_setfield(L, line, eff_name);
+	}
+
+	void measure(lua_State *L, AssStyle *style, std::string const& text, double& width, double& height)
+	{
+		double descent, extlead;
+		if (!Automation4::CalculateTextExtents(style, text, width, height, descent, extlead))
+			error(L, "Some internal error occurred calculating text_extents");
+	}
+
+	class Preprocessor {
+		std::vector<Highlight> highlights;
+		std::vector<Furigana> furi;
+		std::vector<Syllable> syls;
+		std::string text_stripped;
+
+		void ParseText(AssDialogue const& dia);
+		void BasicLayout();
+		double FuriganaLayout(double line_width);
+		void PushSyllables(lua_State *L, int line, int styleref, int furistyle);
+
+	public:
+		void Run(lua_State *L);
+	};
+
+	/// karaskel.preproc_line_text
+	void Preprocessor::ParseText(AssDialogue const& dia)
+	{
+		struct RawSyl {
+			int start_time, end_time, duration;
+			std::string tag, text, text_stripped;
+		};
+		// kara[0] is always an empty syllable, as with parse_karaoke_data
+		std::vector<RawSyl> raw{RawSyl{0, 0, 0, "", "", ""}};
+		for (auto const& syl : AssKaraoke(&dia, false, false))
+			raw.push_back(RawSyl{syl.start_time - dia.Start, syl.start_time + syl.duration - dia.Start,
+				syl.duration, syl.tag_type, syl.GetText(false), syl.text});
+
+		Syllable worksyl;
+		std::string cur_inline_fx;
+		for (size_t i = 0; i < raw.size(); ++i) {
+			auto const& syl = raw[i];
+
+			std::string inline_fx;
+			if (find_inline_fx(syl.text, inline_fx))
+				cur_inline_fx = inline_fx;
+
+			std::string prespace, syltext, postspace;
+			auto const& stripped = syl.text_stripped;
+			size_t first = stripped.find_first_not_of(" \t");
+			if (first == std::string::npos)
+				prespace = stripped;
+			else {
+				size_t last = stripped.find_last_not_of(" \t");
+				prespace = stripped.substr(0, first);
+				syltext = stripped.substr(first, last - first + 1);
+				postspace = stripped.substr(last + 1);
+			}
+
+			std::string prefix = first_char(syltext);
+			if (!is_multi_hl(prefix) && i > 0) {
+				syls.push_back(std::move(worksyl));
+				worksyl = Syllable();
+			}
+
+			highlights.push_back(Highlight{syl.start_time, syl.end_time, syl.duration});
+			worksyl.highlights.push_back(highlights.size() - 1);
+
+			if (syltext.find('|') != std::string::npos || syltext.find("\xEF\xBD\x9C") != std::string::npos) {
+				replace_all(syltext, "\xEF\xBD\x9C", "|");
+				size_t pipe = syltext.find('|');
+				std::string furitext = syltext.substr(pipe + 1);
+				syltext.erase(pipe);
+
+				Furigana f;
+				std::string furiprefix = first_char(furitext);
+				f.isbreak = f.spillback = false;
+				if (furiprefix == "!" || furiprefix == "\xEF\xBC\x81")
+					f.isbreak = true;
+				else if (furiprefix == "<" || furiprefix == "\xEF\xBC\x9C")
+					f.isbreak = f.spillback = true;
+				if (f.isbreak)
+					furitext.erase(0, furiprefix.size());
+
+				f.start_time = syl.start_time;
+				f.end_time = syl.end_time;
+				f.duration = syl.duration;
+				f.kdur = syl.duration / 10.0;
+				f.text = std::move(furitext);
+				f.tag = syl.tag;
+				f.inline_fx = cur_inline_fx;
+				f.syl = syls.size();
+				f.highlight = highlights.size() - 1;
+				furi.push_back(std::move(f));
+				worksyl.furi.push_back(furi.size() - 1);
+			}
+
+			if (!worksyl.has_text || !is_multi_hl(prefix)) {
+				text_stripped += prespace + syltext + postspace;
+
+				worksyl.has_text = true;
+				worksyl.text = syl.text;
+				worksyl.duration = syl.duration;
+				worksyl.kdur = syl.duration / 10.0;
+				worksyl.start_time = syl.start_time;
+				worksyl.end_time = syl.end_time;
+				worksyl.tag = syl.tag;
+				worksyl.text_stripped = prespace + syltext + postspace;
+				worksyl.inline_fx = cur_inline_fx;
+				worksyl.text_spacestripped = std::move(syltext);
+				worksyl.prespace = std::move(prespace);
+				worksyl.postspace = std::move(postspace);
+			}
+			else {
+				worksyl.duration += syl.duration;
+				worksyl.kdur = worksyl.kdur + syl.duration / 10.0;
+				worksyl.end_time = syl.end_time;
+			}
+		}
+		syls.push_back(std::move(worksyl));
+	}
+
+	/// karaskel.do_basic_layout
+	void Preprocessor::BasicLayout()
+	{
+		double curx = 0;
+		for (auto& syl : syls) {
+			syl.left = curx + syl.prespacewidth;
+			syl.center = syl.left + syl.width / 2;
+			syl.right = syl.left + syl.width;
+			curx = curx + syl.prespacewidth + syl.width + syl.postspacewidth;
+		}
+	}
+
+	/// karaskel.do_furigana_layout
+	/// @return The new width of the line
+	double Preprocessor::FuriganaLayout(double line_width)
+	{
+		// The sentinels at each end have no content and never gain a
+		// rightspill, so only the real groups are stored and a default
+		// group stands in for the start sentinel
+		std::vector<LayoutGroup> lgroups;
+		bool last_had_furi = false;
+		LayoutGroup lg;
+		for (size_t s = 0; s < syls.size(); ++s) {
+			auto const& syl = syls[s];
+			bool isbreak = !syl.furi.empty() && furi[syl.furi[0]].isbreak;
+			if ((syl.furi.empty() || isbreak || !last_had_furi) && lg.basewidth > 0) {
+				lgroups.push_back(std::move(lg));
+				lg = LayoutGroup();
+				last_had_furi = false;
+			}
+
+			lg.basewidth = lg.basewidth + syl.prespacewidth + syl.width + syl.postspacewidth;
+			lg.syls.push_back(s);
+
+			for (size_t f : syl.furi) {
+				lg.furiwidth = lg.furiwidth + furi[f].width;
+				lg.spillback = lg.spillback || furi[f].spillback;
+				lg.furi.push_back(f);
+				last_had_furi = true;
+			}
+		}
+		lgroups.push_back(std::move(lg));
+
+		LayoutGroup sentinel;
+		double curx = 0;
+		for (size_t i = 0; i < lgroups.size(); ++i) {
+			auto& lg = lgroups[i];
+			auto& prev = i > 0 ? lgroups[i - 1] : sentinel;
+
+			if (lg.furiwidth == 0) {
+				lg.left = curx;
+				lg.right = lg.left + lg.basewidth;
+				if (prev.has_rightspill && prev.rightspill > 0) {
+					lg.has_rightspill = true;
+					lg.rightspill = prev.rightspill - lg.basewidth;
+					prev.rightspill = 0;
+				}
+				curx = curx + lg.basewidth;
+			}
+			else if (lg.furiwidth <= lg.basewidth) {
+				if (prev.has_rightspill && prev.rightspill > 0) {
+					curx = curx + prev.rightspill;
+					prev.rightspill = 0;
+				}
+				lg.left = curx;
+				lg.right = lg.left + lg.basewidth;
+				curx = curx + lg.basewidth;
+				lg.has_rightspill = true;
+				lg.rightspill = (lg.furiwidth - lg.basewidth) / 2;
+			}
+			else {
+				if (prev.has_rightspill && prev.rightspill > 0) {
+					curx = curx + prev.rightspill;
+					prev.rightspill = 0;
+				}
+				lg.has_rightspill = true;
+				if (lg.spillback) {
+					double leftspill = (lg.furiwidth - lg.basewidth) / 2;
+					lg.rightspill = leftspill;
+					lg.left = prev.has_rightspill ? curx + leftspill : curx;
+				}
+				else {
+					lg.rightspill = lg.furiwidth - lg.basewidth;
+					lg.left = curx;
+				}
+				lg.right = lg.left + lg.basewidth;
+				curx = lg.right;
+			}
+		}
+
+		for (auto const& lg : lgroups) {
+			double curx = lg.left;
+			for (size_t s : lg.syls) {
+				auto& syl = syls[s];
+				syl.left = curx + syl.prespacewidth;
+				syl.center = syl.left + syl.width / 2;
+				syl.right = syl.left + syl.width;
+				curx = syl.right + syl.postspacewidth;
+			}
+			if (curx > line_width) line_width = curx;
+
+			if (lg.furiwidth < lg.basewidth || lg.spillback)
+				curx = lg.left + (lg.basewidth - lg.furiwidth) / 2;
+			else
+				curx = lg.left;
+			for (size_t f : lg.furi) {
+				auto& fu = furi[f];
+				fu.left = curx;
+				fu.center = fu.left + fu.width / 2;
+				fu.right = fu.left + fu.width;
+				curx = fu.right;
+			}
+		}
+		return line_width;
+	}
+
+	/// Build line.kara and line.furi from the preprocessed syllables
+	void Preprocessor::PushSyllables(lua_State *L, int line, int styleref, int furistyle)
+	{
+		bool has_furistyle = !!lua_toboolean(L, furistyle);
+
+		lua_createtable(L, syls.size() - 1, 2);
+		set_field(L, "n", static_cast<int>(syls.size() - 1));
+		int kara = lua_gettop(L);
+		lua_createtable(L, furi.size(), 1);
+		set_field(L, "n", static_cast<int>(furi.size()));
+		int furitable = lua_gettop(L);
+
+		for (size_t s = 0; s < syls.size(); ++s) {
+			auto const& syl = syls[s];
+			lua_createtable(L, 0, 24);
+			int sylidx = lua_gettop(L);
+
+			lua_createtable(L, syl.highlights.size(), 1);
+			set_field(L, "n", static_cast<int>(syl.highlights.size()));
+			int hlidx = lua_gettop(L);
+			for (size_t h = 0; h < syl.highlights.size(); ++h) {
+				auto const& hl = highlights[syl.highlights[h]];
+				lua_createtable(L, 0, 3);
+				set_field(L, "start_time", hl.start_time);
+				set_field(L, "end_time", hl.end_time);
+				set_field(L, "duration", hl.duration);
+				lua_rawseti(L, hlidx, h + 1);
+			}
+
+			lua_createtable(L, syl.furi.size(), 1);
+			set_field(L, "n", static_cast<int>(syl.furi.size()));
+			for (size_t i = 0; i < syl.furi.size(); ++i) {
+				auto const& f = furi[syl.furi[i]];
+				lua_createtable(L, 0, 26);
+				lua_pushvalue(L, sylidx);
+				lua_setfield(L, -2, "syl");
+				set_field(L, "isbreak", f.isbreak);
+				set_field(L, "spillback", f.spillback);
+				set_field(L, "start_time", f.start_time);
+				set_field(L, "end_time", f.end_time);
+				set_field(L, "duration", f.duration);
+				set_field(L, "kdur", f.kdur);
+				set_field(L, "text", f.text);
+				set_field(L, "text_stripped", f.text);
+				set_field(L, "text_spacestripped", f.text);
+				lua_pushvalue(L, line);
+				lua_setfield(L, -2, "line");
+				set_field(L, "tag", f.tag);
+				set_field(L, "inline_fx", f.inline_fx);
+				set_field(L, "i", static_cast<int>(f.syl));
+				set_field(L, "prespace", "");
+				set_field(L, "postspace", "");
+				lua_createtable(L, 1, 1);
+				set_field(L, "n", 1);
+				// The highlight table is shared with the syllable's
+				size_t h = std::find(syl.highlights.begin(), syl.highlights.end(), f.highlight) - syl.highlights.begin();
+				lua_rawgeti(L, hlidx, h + 1);
+				lua_rawseti(L, -2, 1);
+				lua_setfield(L, -2, "highlights");
+				set_field(L, "isfuri", true);
+				if (has_furistyle) {
+					lua_pushvalue(L, furistyle);
+					lua_setfield(L, -2, "style");
+					set_field(L, "width", f.width);
+					set_field(L, "height", f.height);
+					set_field(L, "prespacewidth", 0);
+					set_field(L, "postspacewidth", 0);
+					set_field(L, "left", f.left);
+					set_field(L, "center", f.center);
+					set_field(L, "right", f.right);
+				}
+
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, furitable, syl.furi[i] + 1);
+				lua_rawseti(L, -2, i + 1);
+			}
+			lua_setfield(L, sylidx, "furi");
+			lua_setfield(L, sylidx, "highlights");
+
+			set_field(L, "text", syl.text);
+			set_field(L, "duration", syl.duration);
+			set_field(L, "kdur", syl.kdur);
+			set_field(L, "start_time", syl.start_time);
+			set_field(L, "end_time", syl.end_time);
+			set_field(L, "tag", syl.tag);
+			lua_pushvalue(L, line);
+			lua_setfield(L, sylidx, "line");
+			set_field(L, "i", static_cast<int>(s));
+			set_field(L, "text_stripped", syl.text_stripped);
+			set_field(L, "inline_fx", syl.inline_fx);
+			set_field(L, "text_spacestripped", syl.text_spacestripped);
+			set_field(L, "prespace", syl.prespace);
+			set_field(L, "postspace", syl.postspace);
+			lua_pushvalue(L, styleref);
+			lua_setfield(L, sylidx, "style");
+			set_field(L, "width", syl.width);
+			set_field(L, "height", syl.height);
+			set_field(L, "prespacewidth", syl.prespacewidth);
+			set_field(L, "postspacewidth", syl.postspacewidth);
+			set_field(L, "left", syl.left);
+			set_field(L, "center", syl.center);
+			set_field(L, "right", syl.right);
+
+			lua_rawseti(L, kara, s);
+		}
+
+		lua_setfield(L, line, "furi");
+		lua_setfield(L, line, "kara");
+	}
+
+	void Preprocessor::Run(lua_State *L)
+	{
+		const int meta = 1, styles = 2, line = 3;
+		argcheck(L, !!lua_istable(L, meta), 1, "");
+		argcheck(L, !!lua_istable(L, styles), 2, "");
+		argcheck(L, !!lua_istable(L, line), 3, "");
+		lua_settop(L, 3);
+
+		AssDialogue dia;
+		dia.Text = get_string(L, line, "text");
+		dia.Start = get_int(L, line, "start_time");
+		dia.End = get_int(L, line, "end_time");
+		ParseText(dia);
+
+		std::string style_name = get_string(L, line, "style");
+		lua_getfield(L, styles, style_name.c_str());
+		if (!lua_toboolean(L, -1)) {
+			lua_pop(L, 1);
+			debug_out(L, 2, "WARNING: Style not found: " + style_name + "\n");
+			lua_rawgeti(L, styles, 1);
+		}
+		const int styleref = lua_gettop(L);
+		auto style = Automation4::LuaToAssStyle(L, styleref);
+
+		lua_getfield(L, styles, (style_name + "-furigana").c_str());
+		if (!lua_toboolean(L, -1)) {
+			lua_pop(L, 1);
+			debug_out(L, 4, "No furigana style defined for style '%s'\n", style_name.c_str());
+			lua_pushboolean(L, false);
+		}
+		const int furistyle = lua_gettop(L);
+
+		double factor = get_number(L, meta, "video_x_correct_factor");
+
+		double width, height, descent, extlead;
+		if (!Automation4::CalculateTextExtents(style.get(), text_stripped, width, height, descent, extlead))
+			error(L, "Some internal error occurred calculating text_extents");
+		width = width * factor;
+
+		for (auto& syl : syls) {
+			double unused;
+			measure(L, style.get(), syl.text_spacestripped, syl.width, syl.height);
+			measure(L, style.get(), syl.prespace, syl.prespacewidth, unused);
+			measure(L, style.get(), syl.postspace, syl.postspacewidth, unused);
+			syl.width = syl.width * factor;
+			syl.prespacewidth = syl.prespacewidth * factor;
+			syl.postspacewidth = syl.postspacewidth * factor;
+		}
+
+		if (lua_toboolean(L, furistyle)) {
+			auto fstyle = Automation4::LuaToAssStyle(L, furistyle);
+			for (auto& f : furi) {
+				measure(L, fstyle.get(), f.text, f.width, f.height);
+				f.width = f.width * factor;
+			}
+			width = FuriganaLayout(width);
+		}
+		else
+			BasicLayout();
+
+		PushSyllables(L, line, styleref, furistyle);
+
+		lua_pushvalue(L, line);
+		set_field(L, "text_stripped", text_stripped);
+		set_field(L, "duration", get_number(L, line, "end_time") - get_number(L, line, "start_time"));
+		lua_pushvalue(L, styleref);
+		lua_setfield(L, -2, "styleref");
+		set_field(L, "width", width);
+		set_field(L, "height", height);
+		set_field(L, "descent", descent);
+		set_field(L, "extlead", extlead);
+		lua_pushvalue(L, furistyle);
+		lua_setfield(L, -2, "furistyle");
+
+		lua_getfield(L, line, "margin_t");
+		lua_setfield(L, line, "margin_v");
+		set_eff_margin(L, line, styleref, "margin_l", "eff_margin_l");
+		set_eff_margin(L, line, styleref, "margin_r", "eff_margin_r");
+		set_eff_margin(L, line, styleref, "margin_t", "eff_margin_t");
+		set_eff_margin(L, line, styleref, "margin_b", "eff_margin_b");
+		set_eff_margin(L, line, styleref, "margin_v", "eff_margin_v");
+
+		// Positions are computed from the lua values so that a non-numeric
+		// style margin fails the same way as in karaskel
+		int align = static_cast<int>(get_number(L, styleref, "align"));
+		if (align >= 1 && align <= 9) {
+			double left;
+			const char *halign;
+			switch (align % 3) {
+				case 1:
+					left = get_number(L, line, "eff_margin_l");
+					halign = "left";
+					break;
+				case 2:
+					left = (get_number(L, meta, "res_x") - get_number(L, line, "eff_margin_l") - get_number(L, line, "eff_margin_r") - width) / 2 + get_number(L, line, "eff_margin_l");
+					halign = "center";
+					break;
+				default:
+					left = get_number(L, meta, "res_x") - get_number(L, line, "eff_margin_r") - width;
+					halign = "right";
+					break;
+			}
+			double center = left + width / 2;
+			double right = left + width;
+			set_field(L, "left", left);
+			set_field(L, "center", center);
+			set_field(L, "right", right);
+			set_field(L, "x", align % 3 == 1 ? left : align % 3 == 2 ? center : right);
+			set_field(L, "halign", halign);
+		}
+		lua_getfield(L, line, "center");
+		lua_setfield(L, line, "hcenter");
+
+		if (align >= 1 && align <= 9) {
+			double top, middle, bottom, y;
+			const char *valign;
+			if (align <= 3) {
+				bottom = get_number(L, meta, "res_y") - get_number(L, line, "eff_margin_b");
+				middle = bottom - height / 2;
+				top = bottom - height;
+				y = bottom;
+				valign = "bottom";
+			}
+			else {
+				if (align <= 6) {
+					top = (get_number(L, meta, "res_y") - get_number(L, line, "eff_margin_t") - get_number(L, line, "eff_margin_b") - height) / 2 + get_number(L, line, "eff_margin_t");
+					valign = "middle";
+				}
+				else {
+					top = get_number(L, line, "eff_margin_t");
+					valign = "top";
+				}
+				middle = top + height / 2;
+				bottom = top + height;
+				y = align <= 6 ? middle : top;
+			}
+			set_field(L, "bottom", bottom);
+			set_field(L, "middle", middle);
+			set_field(L, "top", top);
+			set_field(L, "y", y);
+			set_field(L, "valign", valign);
+		}
+		lua_getfield(L, line, "middle");
+		lua_setfield(L, line, "vcenter");
+	}
+}
+
+namespace Automation4 {
+	int LuaKaraskelPreproc(lua_State *L)
+	{
+		Preprocessor().Run(L);
+		return 0;
+	}
+}
@@ -0,0 +1,350 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+/// @file auto4_lua_parallel.cpp
+/// @brief Lua 5.1-based scripting engine (aegisub.parallel_map)
+/// @ingroup scripting
+///
+
+#include "auto4_lua.h"
+
+#include <libaegisub/exception.h>
+#include <libaegisub/lua/utils.h>
+#include <libaegisub/make_unique.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+	using namespace agi::lua;
+
+	DEFINE_EXCEPTION(CopyError, agi::InvalidInputException);
+
+	/// Flattens plain values (nil, booleans, numbers, strings and tables of
+	/// those) into a byte string which can be turned back into the same value
+	/// in a different lua state. Tables which are reachable more than once,
+	/// including through cycles, are written once and then referred to by
+	/// the order in which they were first written.
+	class ValueWriter {
+		std::string out;
+		std::unordered_map<const void *, uint32_t> tables;
+
+		void WriteInt(uint32_t value) {
+			out.append(reinterpret_cast<const char *>(&value), sizeof value);
+		}
+
+		void Write(lua_State *L, int idx) {
+			switch (lua_type(L, idx)) {
+				case LUA_TNIL:
+					out += 'n';
+					break;
+				case LUA_TBOOLEAN:
+					out += lua_toboolean(L, idx) ? 't' : 'f';
+					break;
+				case LUA_TNUMBER: {
+					lua_Number value = lua_tonumber(L, idx);
+					out += 'd';
+					out.append(reinterpret_cast<const char *>(&value), sizeof value);
+					break;
+				}
+				case LUA_TSTRING: {
+					size_t len;
+					const char *str = lua_tolstring(L, idx, &len);
+					out += 's';
+					WriteInt(static_cast<uint32_t>(len));
+					out.append(str, len);
+					break;
+				}
+				case LUA_TTABLE: {
+					auto it = tables.find(lua_topointer(L, idx));
+					if (it != tables.end()) {
+						out += 'r';
+						WriteInt(it->second);
+						break;
+					}
+					tables.emplace(lua_topointer(L, idx), static_cast<uint32_t>(tables.size()));
+
+					if (!lua_checkstack(L, 3))
+						throw CopyError("parallel_map: table is nested too deeply to copy");
+					out += 'T';
+					lua_pushnil(L);
+					while (lua_next(L, idx)) {
+						int top = lua_gettop(L);
+						Write(L, top - 1);
+						Write(L, top);
+						lua_pop(L, 1);
+					}
+					out += 'e';
+					break;
+				}
+				default:
+					throw CopyError(std::string("parallel_map: cannot copy a ") + lua_typename(L, lua_type(L, idx)) + " value to another lua state");
+			}
+		}
+
+	public:
+		static std::string Serialise(lua_State *L, int idx) {
+			ValueWriter writer;
+			writer.Write(L, idx < 0 ? lua_gettop(L) + idx + 1 : idx);
+			return std::move(writer.out);
+		}
+	};
+
+	/// Rebuilds a value written by ValueWriter on top of the stack
+	class ValueReader {
+		const char *pos;
+		/// Stack index of the table holding every table built so far by id
+		int tables;
+		int table_count = 0;
+
+		uint32_t ReadInt() {
+			uint32_t value;
+			memcpy(&value, pos, sizeof value);
+			pos += sizeof value;
+			return value;
+		}
+
+		void Read(lua_State *L) {
+			switch (*pos++) {
+				case 'n': lua_pushnil(L); break;
+				case 't': lua_pushboolean(L, 1); break;
+				case 'f': lua_pushboolean(L, 0); break;
+				case 'd': {
+					lua_Number value;
+					memcpy(&value, pos, sizeof value);
+					pos += sizeof value;
+					lua_pushnumber(L, value);
+					break;
+				}
+				case 's': {
+					uint32_t len = ReadInt();
+					lua_pushlstring(L, pos, len);
+					pos += len;
+					break;
+				}
+				case 'r':
+					lua_rawgeti(L, tables, ReadInt() + 1);
+					break;
+				case 'T':
+					// The writer managed to walk the value with the same
+					// amount of stack space, so this only fails if memory is
+					// exhausted
+					lua_checkstack(L, 3);
+					lua_newtable(L);
+					lua_pushvalue(L, -1);
+					lua_rawseti(L, tables, ++table_count);
+					while (*pos != 'e') {
+						Read(L);
+						Read(L);
+						lua_rawset(L, -3);
+					}
+					++pos;
+					break;
+			}
+		}
+
+	public:
+		static void Push(lua_State *L, std::string const& data) {
+			lua_newtable(L);
+			ValueReader reader;
+			reader.pos = data.data();
+			reader.tables = lua_gettop(L);
+			reader.Read(L);
+			lua_remove(L, -2);
+		}
+	};
+
+	/// Forwards the reports of all of the worker states to the progress sink
+	/// of the calling state, which is not safe to use from several threads
+	class SharedProgressSink final : public agi::ProgressSink {
+		agi::ProgressSink *ps;
+		std::mutex mutex;
+
+	public:
+		SharedProgressSink(agi::ProgressSink *ps) : ps(ps) { }
+
+		void SetIndeterminate() override {
+			std::lock_guard<std::mutex> lock(mutex);
+			ps->SetIndeterminate();
+		}
+		void SetTitle(std::string const& title) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			ps->SetTitle(title);
+		}
+		void SetMessage(std::string const& msg) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			ps->SetMessage(msg);
+		}
+		void SetProgress(int64_t cur, int64_t max) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			ps->SetProgress(cur, max);
+		}
+		void Log(std::string const& str) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			ps->Log(str);
+		}
+		bool IsCancelled() override {
+			std::lock_guard<std::mutex> lock(mutex);
+			return ps->IsCancelled();
+		}
+	};
+
+	/// Run fn on each item in the calling state, for when there are no
+	/// worker states or there is nothing to gain from using them
+	int map_sequential(lua_State *L)
+	{
+		size_t count = lua_objlen(L, 2);
+		lua_createtable(L, count, 0);
+		for (size_t i = 1; i <= count; ++i) {
+			if (lua_type(L, 1) == LUA_TSTRING)
+				lua_getglobal(L, lua_tostring(L, 1));
+			else
+				lua_pushvalue(L, 1);
+			lua_rawgeti(L, 2, i);
+			lua_pushvalue(L, 3);
+			if (lua_pcall(L, 2, 1, 0))
+				throw error_tag();
+			lua_rawseti(L, -2, i);
+		}
+		return 1;
+	}
+}
+
+namespace Automation4 {
+	int RunParallelMap(lua_State *L, std::vector<lua_State *> const& workers)
+	{
+		argcheck(L, lua_isfunction(L, 1) || lua_type(L, 1) == LUA_TSTRING, 1, "function expected");
+		argcheck(L, !!lua_istable(L, 2), 2, "table expected");
+		lua_settop(L, 3);
+
+		size_t count = lua_objlen(L, 2);
+		if (workers.empty() || count < 2)
+			return map_sequential(L);
+
+		// The workers have their own copy of the script, so the function has
+		// to be looked up by name in each of them
+		std::string fn_name;
+		if (lua_type(L, 1) == LUA_TSTRING)
+			fn_name = lua_tostring(L, 1);
+		else {
+			lua_pushnil(L);
+			while (lua_next(L, LUA_GLOBALSINDEX)) {
+				if (lua_type(L, -2) == LUA_TSTRING && lua_rawequal(L, -1, 1)) {
+					fn_name = lua_tostring(L, -2);
+					lua_pop(L, 2);
+					break;
+				}
+				lua_pop(L, 1);
+			}
+			if (fn_name.empty())
+				error(L, "parallel_map: the function must be stored in a global variable so that the worker states can find it");
+		}
+
+		std::vector<std::string> inputs(count);
+		for (size_t i = 0; i < count; ++i) {
+			lua_rawgeti(L, 2, i + 1);
+			inputs[i] = ValueWriter::Serialise(L, -1);
+			lua_pop(L, 1);
+		}
+		std::string shared = ValueWriter::Serialise(L, 3);
+
+		std::unique_ptr<SharedProgressSink> sink;
+		lua_getfield(L, LUA_REGISTRYINDEX, "progress_sink");
+		if (lua_isuserdata(L, -1))
+			sink = agi::make_unique<SharedProgressSink>(LuaProgressSink::GetObjPointer(L, -1));
+		lua_pop(L, 1);
+
+		std::vector<std::string> outputs(count);
+		std::atomic<size_t> next{0}, done{0};
+		std::atomic<bool> failed{false};
+		std::mutex error_mutex;
+		bool cancelled = false;
+		std::string error_message;
+
+		auto fail = [&](bool cancel, std::string const& msg) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!failed.exchange(true)) {
+				cancelled = cancel;
+				error_message = msg;
+			}
+		};
+
+		// Nothing may escape this, as an exception leaving a std::thread
+		// terminates the process
+		auto worker = [&](lua_State *W) {
+			int top = lua_gettop(W);
+			std::unique_ptr<LuaProgressSink> lps;
+			try {
+				if (sink)
+					lps = agi::make_unique<LuaProgressSink>(W, sink.get(), false);
+				ValueReader::Push(W, shared);
+
+				for (size_t i; !failed && (i = next++) < count; ) {
+					lua_getglobal(W, fn_name.c_str());
+					ValueReader::Push(W, inputs[i]);
+					lua_pushvalue(W, top + 1);
+					if (lua_pcall(W, 2, 1, 0)) {
+						// aegisub.cancel() raises nil
+						fail(lua_isnil(W, -1), get_string_or_default(W, -1));
+						break;
+					}
+					outputs[i] = ValueWriter::Serialise(W, -1);
+					lua_pop(W, 1);
+
+					if (sink) {
+						sink->SetProgress(++done, count);
+						if (sink->IsCancelled())
+							fail(true, "");
+					}
+				}
+			}
+			catch (agi::Exception const& e) {
+				fail(false, e.GetMessage());
+			}
+			catch (...) {
+				fail(false, "parallel_map: worker failed");
+			}
+			lua_settop(W, top);
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t i = 1; i < std::min(workers.size(), count); ++i)
+			pool.emplace_back(worker, workers[i]);
+		worker(workers[0]);
+		for (auto& thread : pool)
+			thread.join();
+
+		if (cancelled) {
+			lua_pushnil(L);
+			throw error_tag();
+		}
+		if (failed) {
+			push_value(L, error_message);
+			throw error_tag();
+		}
+
+		lua_createtable(L, count, 0);
+		for (size_t i = 0; i < count; ++i) {
+			ValueReader::Push(L, outputs[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+}
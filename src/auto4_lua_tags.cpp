@@ -0,0 +1,362 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+/// @file auto4_lua_tags.cpp
+/// @brief Lua access to the override tag parser
+/// @ingroup scripting
+///
+/// aegisub.parse_tags turns the text of a line into the same blocks, tags and
+/// parameters that AssDialogue::ParseTags produces, and aegisub.unparse_tags
+/// writes such a structure back to a string.
+
+#include "auto4_lua.h"
+
+#include "ass_dialogue.h"
+#include "utils.h"
+
+#include <libaegisub/lua/utils.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	using namespace agi::lua;
+
+	// Indexed by VariableDataType and AssParameterClass respectively
+	const char *type_names[] = { "int", "float", "text", "bool", "block" };
+	const char *class_names[] = {
+		"normal", "absolute_size", "absolute_pos_x", "absolute_pos_y",
+		"relative_size_x", "relative_size_y", "relative_time_start",
+		"relative_time_end", "karaoke", "drawing", "alpha", "color"
+	};
+
+	void push_tags(lua_State *L, std::vector<AssOverrideTag> const& tags);
+
+	/// Push the typed value of a parameter which is not omitted
+	void push_param_value(lua_State *L, AssOverrideParameter const& param)
+	{
+		switch (param.GetType()) {
+			case VariableDataType::INT:
+				push_value(L, param.Get<int>());
+				break;
+			case VariableDataType::FLOAT:
+				push_value(L, param.Get<double>());
+				break;
+			case VariableDataType::BOOL:
+				push_value(L, param.Get<bool>());
+				break;
+			case VariableDataType::BLOCK:
+				push_tags(L, param.Get<AssDialogueBlockOverride*>()->Tags);
+				break;
+			case VariableDataType::TEXT:
+				if (param.classification == AssParameterClass::ALPHA)
+					push_value(L, param.Get<int>());
+				else
+					push_value(L, param.Get<std::string>());
+				break;
+		}
+	}
+
+	void push_param(lua_State *L, AssOverrideParameter const& param)
+	{
+		lua_createtable(L, 0, 4);
+		set_field(L, "type", type_names[static_cast<int>(param.GetType())]);
+		set_field(L, "class", class_names[static_cast<int>(param.classification)]);
+		if (param.omitted) return;
+
+		// The text as written, so that unparse_tags can write back values
+		// which have not been changed exactly, even if converting them to
+		// the parameter's type lost something
+		set_field(L, "raw", param.Get<std::string>());
+		push_param_value(L, param);
+		lua_setfield(L, -2, "value");
+	}
+
+	void push_tags(lua_State *L, std::vector<AssOverrideTag> const& tags)
+	{
+		lua_createtable(L, tags.size(), 0);
+		for (size_t i = 0; i < tags.size(); ++i) {
+			auto const& tag = tags[i];
+			lua_createtable(L, 0, 3);
+			set_field(L, "name", tag.Name);
+			set_field(L, "valid", tag.IsValid());
+
+			lua_createtable(L, tag.Params.size(), 0);
+			for (size_t j = 0; j < tag.Params.size(); ++j) {
+				push_param(L, tag.Params[j]);
+				lua_rawseti(L, -2, j + 1);
+			}
+			lua_setfield(L, -2, "params");
+
+			lua_rawseti(L, -2, i + 1);
+		}
+	}
+
+	void push_block(lua_State *L, AssDialogueBlock& block)
+	{
+		switch (block.GetType()) {
+			case AssBlockType::PLAIN:
+				lua_createtable(L, 0, 2);
+				set_field(L, "class", "plain");
+				set_field(L, "text", block.GetText());
+				break;
+			case AssBlockType::COMMENT: {
+				// Strip the braces which the block keeps around its text
+				auto text = block.GetText();
+				lua_createtable(L, 0, 2);
+				set_field(L, "class", "comment");
+				lua_pushlstring(L, text.data() + 1, text.size() - 2);
+				lua_setfield(L, -2, "text");
+				break;
+			}
+			case AssBlockType::DRAWING:
+				lua_createtable(L, 0, 3);
+				set_field(L, "class", "drawing");
+				set_field(L, "text", block.GetText());
+				set_field(L, "scale", static_cast<AssDialogueBlockDrawing&>(block).Scale);
+				break;
+			case AssBlockType::OVERRIDE:
+				lua_createtable(L, 0, 2);
+				set_field(L, "class", "override");
+				push_tags(L, static_cast<AssDialogueBlockOverride&>(block).Tags);
+				lua_setfield(L, -2, "tags");
+				break;
+		}
+	}
+
+	/// Get the type to write the parameter table at the top of the stack as,
+	/// falling back to the type of its value if it has no valid type field
+	VariableDataType param_type(lua_State *L)
+	{
+		lua_getfield(L, -1, "type");
+		const char *name = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		if (name) {
+			for (size_t i = 0; i < sizeof(type_names) / sizeof(type_names[0]); ++i) {
+				if (!strcmp(name, type_names[i]))
+					return static_cast<VariableDataType>(i);
+			}
+		}
+
+		lua_getfield(L, -1, "value");
+		int type = lua_type(L, -1);
+		lua_pop(L, 1);
+		switch (type) {
+			case LUA_TBOOLEAN: return VariableDataType::BOOL;
+			case LUA_TNUMBER:  return VariableDataType::FLOAT;
+			case LUA_TTABLE:   return VariableDataType::BLOCK;
+			default:           return VariableDataType::TEXT;
+		}
+	}
+
+	/// Get the class of the parameter table at the top of the stack
+	AssParameterClass param_class(lua_State *L)
+	{
+		lua_getfield(L, -1, "class");
+		const char *name = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		if (name) {
+			for (size_t i = 0; i < sizeof(class_names) / sizeof(class_names[0]); ++i) {
+				if (!strcmp(name, class_names[i]))
+					return static_cast<AssParameterClass>(i);
+			}
+		}
+		return AssParameterClass::NORMAL;
+	}
+
+	/// Check if the parameter table at index idx has a raw field which parses
+	/// to the value at the top of the stack, i.e. the value is unchanged
+	bool value_is_raw(lua_State *L, int idx, VariableDataType type, AssParameterClass cls)
+	{
+		lua_getfield(L, idx, "raw");
+		if (lua_type(L, -1) != LUA_TSTRING) {
+			lua_pop(L, 1);
+			return false;
+		}
+
+		AssOverrideParameter param(type, cls);
+		param.Set(get_string(L, -1));
+		push_param_value(L, param);
+		bool same = !!lua_rawequal(L, -1, -3);
+		lua_pop(L, 1);
+		if (!same) lua_pop(L, 1);
+		return same;
+	}
+
+	void append_string(lua_State *L, int idx, std::string &out)
+	{
+		size_t len;
+		const char *str = lua_tolstring(L, idx, &len);
+		if (!str)
+			error(L, "expected a string, got %s", luaL_typename(L, idx));
+		out.append(str, len);
+	}
+
+	void append_tags(lua_State *L, std::string &out);
+
+	/// Append the parameter table at the top of the stack, returning false
+	/// without writing anything if the parameter is omitted
+	bool append_param(lua_State *L, std::string &out, bool first)
+	{
+		if (!lua_istable(L, -1))
+			error(L, "tag parameter must be a table, got %s", luaL_typename(L, -1));
+
+		int idx = lua_gettop(L);
+		auto type = param_type(L);
+		auto cls = param_class(L);
+		bool alpha = type == VariableDataType::TEXT && cls == AssParameterClass::ALPHA;
+
+		lua_getfield(L, idx, "value");
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			return false;
+		}
+		if (!first) out += ',';
+
+		// Unchanged values are written as they were parsed. Nested blocks
+		// are always rebuilt, as their tags carry their own raw text.
+		if (type != VariableDataType::BLOCK && value_is_raw(L, idx, type, cls)) {
+			append_string(L, -1, out);
+			lua_pop(L, 2);
+			return true;
+		}
+
+		// Strings are written verbatim so that a value can be passed through
+		// unchanged whatever the parameter's type is
+		if (lua_type(L, -1) == LUA_TSTRING)
+			append_string(L, -1, out);
+		else if (type == VariableDataType::BLOCK)
+			append_tags(L, out);
+		else if (type == VariableDataType::BOOL)
+			out += (lua_isboolean(L, -1) ? lua_toboolean(L, -1) : lua_tonumber(L, -1) != 0) ? '1' : '0';
+		else if (type == VariableDataType::FLOAT)
+			out += float_to_string(lua_tonumber(L, -1));
+		else if (alpha) {
+			char buf[8];
+			snprintf(buf, sizeof buf, "&H%02X&", mid<int>(0, lua_tointeger(L, -1), 255));
+			out += buf;
+		}
+		else if (type == VariableDataType::INT)
+			out += std::to_string(static_cast<int>(lua_tointeger(L, -1)));
+		else
+			append_string(L, -1, out);
+
+		lua_pop(L, 1);
+		return true;
+	}
+
+	/// Append the array of tags at the top of the stack
+	void append_tags(lua_State *L, std::string &out)
+	{
+		if (!lua_istable(L, -1))
+			error(L, "tags must be a table, got %s", luaL_typename(L, -1));
+
+		size_t count = lua_objlen(L, -1);
+		for (size_t i = 1; i <= count; ++i) {
+			lua_rawgeti(L, -1, i);
+			if (lua_type(L, -1) == LUA_TSTRING) {
+				append_string(L, -1, out);
+				lua_pop(L, 1);
+				continue;
+			}
+			if (!lua_istable(L, -1))
+				error(L, "tag must be a table or string, got %s", luaL_typename(L, -1));
+
+			lua_getfield(L, -1, "name");
+			if (!lua_isstring(L, -1))
+				error(L, "tag has no name");
+			append_string(L, -1, out);
+			lua_pop(L, 1);
+
+			lua_getfield(L, -1, "params");
+			if (lua_istable(L, -1)) {
+				size_t params = lua_objlen(L, -1);
+				if (params > 1) out += '(';
+				bool first = true;
+				for (size_t j = 1; j <= params; ++j) {
+					lua_rawgeti(L, -1, j);
+					if (append_param(L, out, first))
+						first = false;
+					lua_pop(L, 1);
+				}
+				if (params > 1) out += ')';
+			}
+			lua_pop(L, 2);
+		}
+	}
+
+	/// Append the block table at the top of the stack
+	void append_block(lua_State *L, std::string &out)
+	{
+		if (!lua_istable(L, -1))
+			error(L, "block must be a table, got %s", luaL_typename(L, -1));
+
+		lua_getfield(L, -1, "class");
+		std::string cls = get_string_or_default(L, -1);
+		lua_pop(L, 1);
+
+		if (cls == "override") {
+			lua_getfield(L, -1, "tags");
+			out += '{';
+			append_tags(L, out);
+			out += '}';
+			lua_pop(L, 1);
+			return;
+		}
+		if (cls != "plain" && cls != "drawing" && cls != "comment")
+			error(L, "unknown block class '%s'", cls.c_str());
+
+		lua_getfield(L, -1, "text");
+		if (cls == "comment") out += '{';
+		append_string(L, -1, out);
+		if (cls == "comment") out += '}';
+		lua_pop(L, 1);
+	}
+}
+
+namespace Automation4 {
+	int LuaParseTags(lua_State *L)
+	{
+		AssDialogue diag;
+		diag.Text = check_string(L, 1);
+		auto blocks = diag.ParseTags();
+
+		lua_createtable(L, blocks.size(), 0);
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			push_block(L, *blocks[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	int LuaUnparseTags(lua_State *L)
+	{
+		luaL_checktype(L, 1, LUA_TTABLE);
+		lua_settop(L, 1);
+
+		std::string out;
+		out.reserve(256);
+		size_t count = lua_objlen(L, 1);
+		for (size_t i = 1; i <= count; ++i) {
+			lua_rawgeti(L, 1, i);
+			append_block(L, out);
+			lua_pop(L, 1);
+		}
+		push_value(L, out);
+		return 1;
+	}
+}
@@ -0,0 +1,234 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+/// @file auto4_lua_videoframe.cpp
+/// @brief Lua 5.1-based scripting engine (interface to decoded video frames)
+/// @ingroup scripting
+///
+
+#include "auto4_lua.h"
+
+#include "video_frame.h"
+
+#include <libaegisub/color.h>
+#include <libaegisub/lua/utils.h>
+#include <libaegisub/ycbcr_conv.h>
+
+#include <cstring>
+
+namespace {
+	using namespace agi::lua;
+
+	const char *frame_mt = "aegisub.video_frame";
+
+	using FramePtr = std::shared_ptr<VideoFrame>;
+
+	VideoFrame& check_frame(lua_State *L, int idx)
+	{
+		auto& frame = get<FramePtr>(L, idx, frame_mt);
+		if (!frame)
+			error(L, "Video frame used after the read_frame callback it was passed to returned");
+		return *frame;
+	}
+
+	const char *format_name(VideoFrame::Format format)
+	{
+		switch (format) {
+			case VideoFrame::Format::Gray: return "gray";
+			case VideoFrame::Format::YUV:  return "yuv";
+			default:                       return "bgra";
+		}
+	}
+
+	/// Get a pointer to the first byte of the given row of a plane, taking
+	/// flipped frames into account
+	const unsigned char *row_at(VideoFrame const& frame, int plane, size_t y)
+	{
+		if (frame.flipped)
+			y = frame.PlaneHeight(plane) - y - 1;
+		return frame.Plane(plane) + y * frame.PlanePitch(plane);
+	}
+
+	void check_coords(lua_State *L, VideoFrame const& frame, int& x, int& y)
+	{
+		x = check_int(L, 2);
+		y = check_int(L, 3);
+		argcheck(L, x >= 0 && (size_t)x < frame.width, 2, "x coordinate out of range");
+		argcheck(L, y >= 0 && (size_t)y < frame.height, 3, "y coordinate out of range");
+	}
+
+	int frame_pixel(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		int x, y;
+		check_coords(L, frame, x, y);
+
+		switch (frame.format) {
+			case VideoFrame::Format::BGRA: {
+				auto px = row_at(frame, 0, y) + x * 4;
+				push_value(L, px[2]);
+				push_value(L, px[1]);
+				push_value(L, px[0]);
+				return 3;
+			}
+			case VideoFrame::Format::Gray:
+				push_value(L, row_at(frame, 0, y)[x]);
+				return 1;
+			case VideoFrame::Format::YUV: {
+				int cx = x >> frame.chroma_shift_w, cy = y >> frame.chroma_shift_h;
+				push_value(L, row_at(frame, 0, y)[x]);
+				push_value(L, row_at(frame, 1, cy)[cx]);
+				push_value(L, row_at(frame, 2, cy)[cx]);
+				return 3;
+			}
+		}
+		return 0;
+	}
+
+	int frame_pixel_color(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		if (frame.format != VideoFrame::Format::BGRA)
+			error(L, "pixel_color is only supported for bgra frames");
+		int x, y;
+		check_coords(L, frame, x, y);
+		auto px = row_at(frame, 0, y) + x * 4;
+		push_value(L, agi::Color(px[2], px[1], px[0]).GetAssOverrideFormatted());
+		return 1;
+	}
+
+	/// Push a pointer to the top row of a plane of the frame along with the
+	/// stride in bytes between rows. The stride is negative for bottom-up
+	/// frames so that callers can always address pixels as ptr[y * stride + x].
+	int frame_data(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		int plane = lua_isnoneornil(L, 2) ? 0 : check_int(L, 2);
+		argcheck(L, plane >= 0 && plane < frame.PlaneCount(), 2, "plane out of range");
+
+		auto data = const_cast<unsigned char *>(row_at(frame, plane, 0));
+		int pitch = static_cast<int>(frame.PlanePitch(plane));
+		push_value(L, static_cast<void *>(data));
+		push_value(L, frame.flipped ? -pitch : pitch);
+		return 2;
+	}
+
+	/// Push the frame as a string of packed 8-bit RGB, top row first
+	int frame_rgb(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		if (frame.format == VideoFrame::Format::YUV)
+			error(L, "rgb is not supported for yuv frames");
+		auto rgb = GetRGB(frame);
+		lua_pushlstring(L, reinterpret_cast<const char *>(rgb.data()), rgb.size());
+		return 1;
+	}
+
+	int frame_to_ycbcr(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		if (frame.format != VideoFrame::Format::BGRA)
+			error(L, "to_ycbcr is only supported for bgra frames");
+
+		std::string matrix_name = lua_isnoneornil(L, 2) ? "709" : check_string(L, 2);
+		std::string range_name = lua_isnoneornil(L, 3) ? "tv" : check_string(L, 3);
+
+		agi::ycbcr_matrix matrix;
+		if (matrix_name == "601") matrix = agi::ycbcr_matrix::bt601;
+		else if (matrix_name == "709") matrix = agi::ycbcr_matrix::bt709;
+		else if (matrix_name == "fcc") matrix = agi::ycbcr_matrix::fcc;
+		else if (matrix_name == "240m") matrix = agi::ycbcr_matrix::smpte_240m;
+		else return error(L, "unknown matrix '%s'", matrix_name.c_str());
+
+		agi::ycbcr_range range;
+		if (range_name == "tv") range = agi::ycbcr_range::tv;
+		else if (range_name == "pc") range = agi::ycbcr_range::pc;
+		else return error(L, "unknown range '%s'", range_name.c_str());
+
+		Automation4::PushVideoFrame(L, std::make_shared<VideoFrame>(ConvertToYCbCr(frame, matrix, range)));
+		return 1;
+	}
+
+	int frame_downsample(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		int levels = lua_isnoneornil(L, 2) ? 1 : check_int(L, 2);
+		argcheck(L, levels >= 1, 2, "levels must be at least 1");
+
+		auto out = std::make_shared<VideoFrame>(Downsample(frame));
+		for (int i = 1; i < levels && (out->width > 1 || out->height > 1); ++i)
+			*out = Downsample(*out);
+		Automation4::PushVideoFrame(L, std::move(out));
+		return 1;
+	}
+
+	int frame_index(lua_State *L)
+	{
+		auto& frame = check_frame(L, 1);
+		const char *key = lua_tostring(L, 2);
+		if (!key)
+			lua_pushnil(L);
+		else if (!strcmp(key, "width"))
+			push_value(L, frame.width);
+		else if (!strcmp(key, "height"))
+			push_value(L, frame.height);
+		else if (!strcmp(key, "pitch"))
+			push_value(L, frame.pitch);
+		else if (!strcmp(key, "format"))
+			push_value(L, format_name(frame.format));
+		else if (!strcmp(key, "planes"))
+			push_value(L, frame.PlaneCount());
+		else if (!strcmp(key, "pixel"))
+			lua_pushcfunction(L, exception_wrapper<frame_pixel>);
+		else if (!strcmp(key, "pixel_color"))
+			lua_pushcfunction(L, exception_wrapper<frame_pixel_color>);
+		else if (!strcmp(key, "data"))
+			lua_pushcfunction(L, exception_wrapper<frame_data>);
+		else if (!strcmp(key, "rgb"))
+			lua_pushcfunction(L, exception_wrapper<frame_rgb>);
+		else if (!strcmp(key, "to_ycbcr"))
+			lua_pushcfunction(L, exception_wrapper<frame_to_ycbcr>);
+		else if (!strcmp(key, "downsample"))
+			lua_pushcfunction(L, exception_wrapper<frame_downsample>);
+		else
+			lua_pushnil(L);
+		return 1;
+	}
+
+	int frame_gc(lua_State *L)
+	{
+		get<FramePtr>(L, 1, frame_mt).~FramePtr();
+		return 0;
+	}
+}
+
+namespace Automation4 {
+	void PushVideoFrame(lua_State *L, std::shared_ptr<VideoFrame> frame)
+	{
+		if (luaL_newmetatable(L, frame_mt)) {
+			set_field<frame_index>(L, "__index");
+			set_field<frame_gc>(L, "__gc");
+		}
+		lua_pop(L, 1);
+
+		make<FramePtr>(L, frame_mt, std::move(frame));
+	}
+
+	void ReleaseVideoFrame(lua_State *L, int idx)
+	{
+		get<FramePtr>(L, idx, frame_mt).reset();
+	}
+}
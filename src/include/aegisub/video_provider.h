@@ -48,6 +48,14 @@ public:
 	/// Override this method to actually get frames
 	virtual void GetFrame(int n, VideoFrame &frame)=0;
 
+	/// @brief Get a frame which may reference the provider's own buffers
+	///
+	/// The frame is only valid until the next call into the provider, which
+	/// lets providers skip copying the pixel data for consumers which are done
+	/// with a frame before asking for another one. Providers which can't hand
+	/// out their buffers just copy the frame as GetFrame does.
+	virtual void GetFrameView(int n, VideoFrame &frame) { GetFrame(n, frame); }
+
 	/// Set the YCbCr matrix to the specified one
 	///
 	/// Providers are free to disregard this, and should if the requested
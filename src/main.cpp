@@ -39,26 +39,31 @@
 #include "aegisublocale.h"
 #include "ass_dialogue.h"
 #include "ass_file.h"
+#include "async_video_provider.h"
 #include "auto4_base.h"
 #include "auto4_lua_factory.h"
 #include "include/aegisub/context.h"
 #include "libresrc/libresrc.h"
 #include "options.h"
 #include "project.h"
+#include "resolution_resampler.h"
 #include "selection_controller.h"
 #include "subs_controller.h"
 #include "utils.h"
 #include "version.h"
+#include "video_frame.h"
 
 #include <libaegisub/dispatch.h>
 #include <libaegisub/format_path.h>
 #include <libaegisub/fs.h>
 #include <libaegisub/io.h>
 #include <libaegisub/json.h>
+#include <libaegisub/keyframe.h>
 #include <libaegisub/log.h>
 #include <libaegisub/make_unique.h>
 #include <libaegisub/option.h>
 #include <libaegisub/path.h>
+#include <libaegisub/scene_detect.h>
 #include <libaegisub/split.h>
 #include <libaegisub/util.h>
 
@@ -115,6 +120,58 @@ std::set<int> parse_range(const std::string& s) {
 	return lines;
 }
 
+/// Parse a frame size of the form WxH, where either dimension may be left
+/// out or given as 0 to keep the video's aspect ratio
+std::pair<int, int> parse_size(const std::string& s) {
+	auto sep = s.find('x');
+	if (sep == std::string::npos) {
+		throw agi::InvalidInputException("Invalid size, expected WxH: " + s);
+	}
+
+	int w = 0, h = 0;
+	auto w_str = s.substr(0, sep), h_str = s.substr(sep + 1);
+	if ((!w_str.empty() && !boost::conversion::try_lexical_convert(w_str, w)) ||
+		(!h_str.empty() && !boost::conversion::try_lexical_convert(h_str, h)) ||
+		w < 0 || h < 0) {
+		throw agi::InvalidInputException("Invalid size, expected WxH: " + s);
+	}
+	return {w, h};
+}
+
+/// Find the scene changes in the loaded video and write them to a keyframe
+/// file, which is then loaded as the project's keyframes
+bool detect_scenes(agi::Context *context, agi::fs::path const& file) {
+	auto provider = context->project->VideoProvider();
+	if (!provider) {
+		StartupError("--detect-scenes requires --video");
+		return false;
+	}
+
+	agi::SceneDetector detector;
+	int frames = provider->GetFrameCount();
+	for (int n = 0; n < frames; ++n) {
+		provider->ReadFrame(n, [&](VideoFrame const& frame) {
+			// Pass the top row so that flipped frames compare the same way
+			// as everything else, though only consistency matters here
+			auto pitch = static_cast<ptrdiff_t>(frame.PlanePitch(0));
+			auto data = frame.Plane(0);
+			if (frame.flipped) {
+				data += (frame.height - 1) * pitch;
+				pitch = -pitch;
+			}
+			detector.AddFrame(data, frame.width, frame.height, pitch,
+				frame.format == VideoFrame::Format::BGRA ? 4 : 1);
+		});
+		if (n % 1000 == 999)
+			StartupLog(agi::format("Scene detection: %d/%d frames", n + 1, frames));
+	}
+
+	auto keyframes = detector.SceneChanges();
+	LOG_I("main") << "Found " << keyframes.size() << " scenes";
+	agi::keyframe::Save(file, keyframes);
+	return context->project->LoadKeyframes(file);
+}
+
 std::unique_ptr<Automation4::Script> find_script(const std::string& file)
 {
 	auto absolute = agi::fs::path(file);
@@ -257,9 +314,18 @@ int main(int argc, char **argv) {
 	flags.add_options()
 		("help", "produce help message")
 		("video", boost::program_options::value<std::string>(), "video to load")
+		("video-format", boost::program_options::value<std::string>(), "pixel format of decoded video frames: bgra, yuv or gray")
+		("video-size", boost::program_options::value<std::string>(), "scale decoded video frames to WxH")
+		("audio", boost::program_options::value<std::string>(), "audio to load; may be the same file as --video")
+		("audio-cache", boost::program_options::value<std::string>(), "how to cache decoded audio: none, ram or hd")
+		("audio-wait", boost::program_options::value<int>(), "milliseconds reads of audio which is still being cached wait for it")
 		("timecodes", boost::program_options::value<std::string>(), "timecodes to load")
 		("keyframes", boost::program_options::value<std::string>(), "keyframes to load")
+		("detect-scenes", boost::program_options::value<std::string>(), "find scene changes in the video, write them to a keyframe file and load them as the keyframes")
 		("automation", boost::program_options::value<std::vector<std::string>>(), "an automation script to run")
+		("resample", boost::program_options::value<std::string>(), "resample the subtitles to a WxH script resolution before running the macro")
+		("text-extents", boost::program_options::value<std::string>(), "how aegisub.text_extents measures text: system or freetype")
+		("lua-workers", boost::program_options::value<int>(), "number of copies of a script aegisub.parallel_map runs on; 0 = one per CPU core")
 		("active-line", boost::program_options::value<int>()->default_value(-1), "the active line")
 		("selected-lines", boost::program_options::value<std::string>()->default_value(""), "the selected lines")
 		("dialog", boost::program_options::value<std::vector<std::string>>(), "response to a dialog, in JSON")
@@ -277,11 +343,14 @@ int main(int argc, char **argv) {
 		options(cmdline).positional(posdesc).run(), vm);
 	boost::program_options::notify(vm);
 
-	if (vm.count("help") || !vm.count("macro")) {
-		if (!vm.count("macro")) {
+	// --resample is a task of its own, so the macro is optional with it
+	bool has_task = vm.count("macro") || (vm.count("resample") && vm.count("out-file"));
+	if (vm.count("help") || !has_task) {
+		if (!has_task) {
 			std::cout << "Too few arguments." << std::endl;
 		}
 		std::cout << argv[0] << " [options] <input file> <output file> <macro>" << std::endl;
+		std::cout << argv[0] << " --resample WxH [options] <input file> <output file> [<macro>]" << std::endl;
 		std::cout << flags << std::endl;
 		return 1;
 	}
@@ -422,6 +491,21 @@ int main(int argc, char **argv) {
 			return 2;
 		}
 
+		if (vm.count("video-format")) {
+			auto format = vm["video-format"].as<std::string>();
+			if (format != "bgra" && format != "yuv" && format != "gray") {
+				StartupError("Invalid video format: ") << format;
+				return 1;
+			}
+			OPT_SET("Provider/Video/FFmpegSource/Output Format")->SetString(format);
+		}
+
+		if (vm.count("video-size")) {
+			auto size = parse_size(vm["video-size"].as<std::string>());
+			OPT_SET("Provider/Video/FFmpegSource/Output Width")->SetInt(size.first);
+			OPT_SET("Provider/Video/FFmpegSource/Output Height")->SetInt(size.second);
+		}
+
 		if (vm.count("video")) {
 			StartupLog("Loading video...");
 			if (!context->project->LoadVideo(
@@ -430,6 +514,30 @@ int main(int argc, char **argv) {
 			}
 		}
 
+		if (vm.count("audio-cache")) {
+			auto cache = vm["audio-cache"].as<std::string>();
+			int type;
+			if (cache == "none") type = 0;
+			else if (cache == "ram") type = 1;
+			else if (cache == "hd") type = 2;
+			else {
+				StartupError("Invalid audio cache type: ") << cache;
+				return 1;
+			}
+			OPT_SET("Audio/Cache/Type")->SetInt(type);
+		}
+
+		if (vm.count("audio-wait"))
+			OPT_SET("Audio/Cache/Wait")->SetInt(std::max(0, vm["audio-wait"].as<int>()));
+
+		if (vm.count("audio")) {
+			StartupLog("Loading audio...");
+			if (!context->project->LoadAudio(
+					boost::filesystem::absolute(vm["audio"].as<std::string>()))) {
+				return 2;
+			}
+		}
+
 		if (vm.count("timecodes")) {
 			StartupLog("Loading timecodes...");
 			if (!context->project->LoadTimecodes(
@@ -438,6 +546,12 @@ int main(int argc, char **argv) {
 			}
 		}
 
+		if (vm.count("detect-scenes")) {
+			StartupLog("Detecting scene changes...");
+			if (!detect_scenes(context.get(), boost::filesystem::absolute(vm["detect-scenes"].as<std::string>())))
+				return 2;
+		}
+
 		if (vm.count("keyframes")) {
 			StartupLog("Loading keyframes...");
 			if (!context->project->LoadKeyframes(
@@ -502,6 +616,30 @@ int main(int argc, char **argv) {
 			}
 		}
 
+		if (vm.count("text-extents")) {
+			auto engine = vm["text-extents"].as<std::string>();
+			if (engine != "system" && engine != "freetype") {
+				StartupError("Invalid text extents engine: ") << engine;
+				return 1;
+			}
+#ifndef WITH_HARFBUZZ
+			if (engine == "freetype") {
+				StartupError("This build does not support --text-extents freetype");
+				return 1;
+			}
+#endif
+			OPT_SET("Automation/Text Extents")->SetString(engine);
+		}
+
+		if (vm.count("lua-workers")) {
+			int workers = vm["lua-workers"].as<int>();
+			if (workers < 0) {
+				StartupError("Invalid number of Lua workers: ") << workers;
+				return 1;
+			}
+			OPT_SET("Automation/Parallel Workers")->SetInt(workers);
+		}
+
 		// Load Automation scripts
 		StartupLog("Load automation script");
 		// cache cwd in case automation changes it
@@ -519,11 +657,23 @@ int main(int argc, char **argv) {
 			}
 		}
 
-		auto macro = vm["macro"].as<std::string>();
-		StartupLog("Calling: ") << macro;
-		if (!cmd::call(macro, context.get())) {
-			StartupError("Skipping automation because validation function returned false");
-			return 1;
+		if (vm.count("resample")) {
+			auto size = parse_size(vm["resample"].as<std::string>());
+			if (size.first <= 0 || size.second <= 0) {
+				StartupError("Invalid resample resolution: ") << vm["resample"].as<std::string>();
+				return 1;
+			}
+			StartupLog("Resampling subtitles...");
+			ResampleResolution(context.get(), size.first, size.second);
+		}
+
+		if (vm.count("macro")) {
+			auto macro = vm["macro"].as<std::string>();
+			StartupLog("Calling: ") << macro;
+			if (!cmd::call(macro, context.get())) {
+				StartupError("Skipping automation because validation function returned false");
+				return 1;
+			}
 		}
 
 		// restore cwd for saving
@@ -19,6 +19,7 @@
 #include "ass_dialogue.h"
 #include "ass_file.h"
 #include "async_video_provider.h"
+#include "audio_provider_factory.h"
 #include "charset_detect.h"
 #include "dialog_progress.h"
 #include "include/aegisub/context.h"
@@ -29,6 +30,7 @@
 #include "utils.h"
 #include "video_controller.h"
 
+#include <libaegisub/audio/envelope.h>
 #include <libaegisub/audio/provider.h>
 #include <libaegisub/format_path.h>
 #include <libaegisub/fs.h>
@@ -38,12 +40,20 @@
 #include <libaegisub/path.h>
 
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/crc.hpp>
 #include <boost/filesystem/operations.hpp>
 
 Project::Project(agi::Context *c) : context(c) {
+	OPT_SUB("Audio/Cache/HD/Location", &Project::ReloadAudio, this);
+	OPT_SUB("Audio/Cache/Type", &Project::ReloadAudio, this);
+	OPT_SUB("Audio/Cache/Wait", &Project::ReloadAudio, this);
+	OPT_SUB("Audio/Provider", &Project::ReloadAudio, this);
 	OPT_SUB("Provider/Avisynth/Allow Ancient", &Project::ReloadVideo, this);
 	OPT_SUB("Provider/Avisynth/Memory Max", &Project::ReloadVideo, this);
 	OPT_SUB("Provider/Video/FFmpegSource/Decoding Threads", &Project::ReloadVideo, this);
+	OPT_SUB("Provider/Video/FFmpegSource/Output Format", &Project::ReloadVideo, this);
+	OPT_SUB("Provider/Video/FFmpegSource/Output Height", &Project::ReloadVideo, this);
+	OPT_SUB("Provider/Video/FFmpegSource/Output Width", &Project::ReloadVideo, this);
 	OPT_SUB("Provider/Video/FFmpegSource/Unsafe Seeking", &Project::ReloadVideo, this);
 	OPT_SUB("Subtitle/Provider", &Project::ReloadVideo, this);
 	OPT_SUB("Video/Provider", &Project::ReloadVideo, this);
@@ -58,6 +68,11 @@ void Project::UpdateRelativePaths() {
 	context->ass->Properties.keyframes_file = context->path->MakeRelative(keyframes_file, "?script").generic_string();
 }
 
+void Project::ReloadAudio() {
+	if (audio_provider)
+		DoLoadAudio(audio_file);
+}
+
 void Project::ReloadVideo() {
 	if (video_provider) {
 		DoLoadVideo(video_file);
@@ -147,6 +162,97 @@ void Project::CloseSubtitles() {
 	context->selectionController->SetSelectionAndActive({line}, line);
 }
 
+bool Project::DoLoadAudio(agi::fs::path const& path) {
+	if (!progress)
+		progress = new DialogProgress();
+
+	try {
+		audio_envelope.reset();
+		audio_provider = AudioProviderFactory::GetProvider(path, *context->path, progress);
+	}
+	catch (agi::UserCancelException const&) { return false; }
+	catch (agi::fs::FileSystemError const& err) {
+		config::mru->Remove("Audio", path);
+		ShowError(err.GetMessage());
+		return false;
+	}
+	catch (agi::AudioProviderError const& err) {
+		ShowError(err.GetMessage());
+		return false;
+	}
+
+	SetPath(audio_file, "?audio", "Audio", path);
+	AnnounceAudioProviderModified(audio_provider.get());
+	return true;
+}
+
+bool Project::LoadAudio(agi::fs::path path) {
+	if (path.empty()) return false;
+	return DoLoadAudio(path);
+}
+
+void Project::CloseAudio() {
+	AnnounceAudioProviderModified(nullptr);
+	audio_envelope.reset();
+	audio_provider.reset();
+	SetPath(audio_file, "?audio", "", "");
+}
+
+namespace {
+/// Get the path the envelope of the given audio file is cached at, keyed on
+/// the file's name, size and modification time in the same way as the FFMS2
+/// index cache, and on how the provider decoded and converted the audio
+agi::fs::path EnvelopeCacheFilename(agi::fs::path const& filename, agi::AudioProvider const& provider) {
+	uintmax_t len = agi::fs::Size(filename);
+
+	std::string key = filename.string() + '\0' + provider.GetDecodeKey();
+	boost::crc_32_type hash;
+	hash.process_bytes(key.c_str(), key.size());
+
+	return config::path->Decode("?local/envelope/" + std::to_string(hash.checksum()) + "_" + std::to_string(len) + "_" + std::to_string(agi::fs::ModifiedTime(filename)) + ".envelope");
+}
+}
+
+agi::AudioEnvelope const *Project::AudioEnvelope() {
+	if (!audio_provider) return nullptr;
+	if (audio_envelope) return audio_envelope.get();
+
+	// Dummy audio and anything else which isn't a real file doesn't get a
+	// cache file, as there'd be nothing to key it on
+	agi::fs::path cache_file;
+	try {
+		cache_file = EnvelopeCacheFilename(audio_file, *audio_provider);
+	}
+	catch (agi::fs::FileSystemError const&) { }
+
+	if (!cache_file.empty() && agi::fs::FileExists(cache_file)) {
+		try {
+			audio_envelope = agi::make_unique<agi::AudioEnvelope>(cache_file, *audio_provider);
+			return audio_envelope.get();
+		}
+		catch (agi::Exception const& e) {
+			LOG_I("project/envelope") << "discarding envelope cache " << cache_file << ": " << e.GetMessage();
+		}
+	}
+
+	audio_envelope = agi::make_unique<agi::AudioEnvelope>(*audio_provider);
+
+	if (!cache_file.empty()) {
+		try {
+			agi::fs::CreateDirectory(cache_file.parent_path());
+			audio_envelope->Save(cache_file);
+			CleanCache(cache_file.parent_path(), "*.envelope",
+				OPT_GET("Audio/Cache/Envelope/Size")->GetInt(),
+				OPT_GET("Audio/Cache/Envelope/Files")->GetInt());
+		}
+		catch (agi::Exception const& e) {
+			LOG_W("project/envelope") << "failed to write envelope cache " << cache_file << ": " << e.GetMessage();
+		}
+	}
+
+	return audio_envelope.get();
+}
+
 bool Project::DoLoadVideo(agi::fs::path const& path) {
 	if (!progress)
 		progress = new DialogProgress();
@@ -393,4 +499,7 @@ void Project::LoadList(std::vector<agi::fs::path> const& files) {
 		if (!keyframes.empty())
 			LoadKeyframes(keyframes);
 	}
+
+	if (!audio.empty())
+		DoLoadAudio(audio);
 }
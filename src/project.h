@@ -27,10 +27,16 @@
 
 class AsyncVideoProvider;
 class DialogProgress;
-namespace agi { struct Context; }
+namespace agi {
+	class AudioEnvelope;
+	class AudioProvider;
+	struct Context;
+}
 struct ProjectProperties;
 
 class Project {
+	std::unique_ptr<agi::AudioProvider> audio_provider;
+	std::unique_ptr<agi::AudioEnvelope> audio_envelope;
 	std::unique_ptr<AsyncVideoProvider> video_provider;
 	agi::vfr::Framerate timecodes;
 	std::vector<int> keyframes;
@@ -40,6 +46,7 @@ class Project {
 	agi::fs::path timecodes_file;
 	agi::fs::path keyframes_file;
 
+	agi::signal::Signal<agi::AudioProvider *> AnnounceAudioProviderModified;
 	agi::signal::Signal<AsyncVideoProvider *> AnnounceVideoProviderModified;
 	agi::signal::Signal<agi::vfr::Framerate const&> AnnounceTimecodesModified;
 	agi::signal::Signal<std::vector<int> const&> AnnounceKeyframesModified;
@@ -51,6 +58,7 @@ class Project {
 	void ShowError(std::string const& message);
 
 	bool DoLoadSubtitles(agi::fs::path const& path, std::string encoding, ProjectProperties &properties);
+	bool DoLoadAudio(agi::fs::path const& path);
 	bool DoLoadVideo(agi::fs::path const& path);
 	void DoLoadTimecodes(agi::fs::path const& path);
 	void DoLoadKeyframes(agi::fs::path const& path);
@@ -69,6 +77,15 @@ public:
 	void CloseSubtitles();
 	bool CanLoadSubtitlesFromVideo() const { return video_has_subtitles; }
 
+	bool LoadAudio(agi::fs::path path);
+	void CloseAudio();
+	agi::AudioProvider *AudioProvider() const { return audio_provider.get(); }
+	agi::fs::path const& AudioName() const { return audio_file; }
+	/// Get the min/max/RMS envelope of the open audio, computing it (or
+	/// loading it from the on-disk cache) the first time it is needed
+	/// @return nullptr if no audio is open
+	agi::AudioEnvelope const *AudioEnvelope();
+
 	bool LoadVideo(agi::fs::path path);
 	void CloseVideo();
 	AsyncVideoProvider *VideoProvider() const { return video_provider.get(); }
@@ -86,6 +103,7 @@ public:
 
 	void LoadList(std::vector<agi::fs::path> const& files);
 
+	DEFINE_SIGNAL_ADDERS(AnnounceAudioProviderModified, AddAudioProviderListener)
 	DEFINE_SIGNAL_ADDERS(AnnounceVideoProviderModified, AddVideoProviderListener)
 	DEFINE_SIGNAL_ADDERS(AnnounceTimecodesModified, AddTimecodesListener)
 	DEFINE_SIGNAL_ADDERS(AnnounceKeyframesModified, AddKeyframesListener)
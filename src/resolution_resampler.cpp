@@ -26,14 +26,19 @@
 
 #include <libaegisub/exception.h>
 #include <libaegisub/of_type_adaptor.h>
-#include <libaegisub/split.h>
 #include <libaegisub/util.h>
 #include <libaegisub/ycbcr_conv.h>
 #include <libaegisub/log.h>
 
 #include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string/predicate.hpp>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 enum {
 	LEFT = 0,
@@ -67,36 +72,58 @@ std::vector<std::string> MatrixNames() {
 }
 
 namespace {
-	std::string transform_drawing(std::string const& drawing, int shift_x, int shift_y, double scale_x, double scale_y) {
-		bool is_x = true;
-		std::string final;
-		final.reserve(drawing.size());
-
-		for (auto const& cur : agi::Split(drawing, ' ')) {
-			double val;
-			if (agi::util::try_parse(agi::str(cur), &val)) {
-				if (is_x)
-					val = (val + shift_x) * scale_x;
-				else
-					val = (val + shift_y) * scale_y;
-				val = round(val * 8) / 8.0; // round to eighth-pixels
-				final += float_to_string(val);
-				final += ' ';
-				is_x = !is_x;
-			}
-			else if (cur.size() == 1) {
-				char c = tolower(cur[0]);
-				if (c == 'm' || c == 'n' || c == 'l' || c == 'b' || c == 's' || c == 'p' || c == 'c') {
-					is_x = true;
-					final += c;
-					final += ' ';
-				}
-			}
+	/// Length of the plain decimal number (optionally signed, with a fraction
+	/// and an exponent) at the start of [p, end), or 0 if there isn't one
+	size_t scan_number(const char *p, const char *end) {
+		const char *start = p;
+		if (p != end && (*p == '+' || *p == '-')) ++p;
+
+		const char *digits = p;
+		while (p != end && *p >= '0' && *p <= '9') ++p;
+		bool any_digits = p != digits;
+		if (p != end && *p == '.') {
+			digits = ++p;
+			while (p != end && *p >= '0' && *p <= '9') ++p;
+			any_digits = any_digits || p != digits;
+		}
+		if (!any_digits) return 0;
+
+		if (p != end && (*p == 'e' || *p == 'E')) {
+			const char *exp = p + 1;
+			if (exp != end && (*exp == '+' || *exp == '-')) ++exp;
+			digits = exp;
+			while (exp != end && *exp >= '0' && *exp <= '9') ++exp;
+			if (exp != digits) p = exp;
+		}
+		return p - start;
+	}
+
+	/// Append val rounded to eighth-pixels. Eighths always fit in three
+	/// decimal places, so this produces the same text as float_to_string
+	/// without going through printf.
+	void append_eighths(std::string &out, double val) {
+		double eighths = round(val * 8);
+		if (!(std::abs(eighths) < 1e15)) {
+			out += float_to_string(eighths / 8.0);
+			return;
 		}
 
-		if (final.size())
-			final.pop_back();
-		return final;
+		auto n = static_cast<int64_t>(eighths);
+		if (n < 0 || std::signbit(eighths))
+			out += '-';
+		uint64_t abs_n = n < 0 ? -static_cast<uint64_t>(n) : n;
+
+		char buf[20];
+		char *end = buf + sizeof buf, *p = end;
+		uint64_t whole = abs_n / 8;
+		do {
+			*--p = '0' + whole % 10;
+			whole /= 10;
+		} while (whole);
+		out.append(p, end);
+
+		static const char *const fractions[] = {"", ".125", ".25", ".375", ".5", ".625", ".75", ".875"};
+		out += fractions[abs_n % 8];
 	}
 
 	struct resample_state {
@@ -137,7 +164,7 @@ namespace {
 				break;
 
 			case AssParameterClass::DRAWING: {
-				cur->Set(transform_drawing(
+				cur->Set(TransformDrawing(
 					cur->Get<std::string>(),
 					state->margin[LEFT], state->margin[TOP], state->rx, state->ry));
 				return;
@@ -169,7 +196,7 @@ namespace {
 			block->ProcessParameters(resample_tags, state);
 
 		for (auto drawing : blocks | agi::of_type<AssDialogueBlockDrawing>())
-			drawing->text = transform_drawing(drawing->text, 0, 0, state->rx / state->ar, state->ry);
+			drawing->text = TransformDrawing(drawing->text, 0, 0, state->rx / state->ar, state->ry);
 
 		for (size_t i = 0; i < 3; ++i) {
 			if (diag.Margin[i])
@@ -179,6 +206,46 @@ namespace {
 		diag.UpdateText(blocks);
 	}
 
+	/// Resample all of the lines, spread over a few threads since each line
+	/// is parsed and rebuilt independently of the others
+	void resample_lines(resample_state *state, EntryList<AssDialogue>& events) {
+		std::vector<AssDialogue *> lines;
+		for (auto& line : events)
+			lines.push_back(&line);
+
+		// Hand out lines in small batches to keep the threads evenly loaded
+		// without contending on the counter for every line
+		const size_t batch = 64;
+		std::atomic<size_t> next{0};
+		std::exception_ptr error;
+		std::mutex error_lock;
+		auto worker = [&] {
+			try {
+				for (size_t start; (start = next.fetch_add(batch)) < lines.size(); ) {
+					for (size_t i = start; i < std::min(start + batch, lines.size()); ++i)
+						resample_line(state, *lines[i]);
+				}
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(error_lock);
+				if (!error)
+					error = std::current_exception();
+				next = lines.size();
+			}
+		};
+
+		auto threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (lines.size() + batch - 1) / batch);
+		std::vector<std::thread> pool;
+		for (size_t i = 1; i < threads; ++i)
+			pool.emplace_back(worker);
+		worker();
+		for (auto& thread : pool)
+			thread.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
 	void resample_style(resample_state *state, AssStyle &style) {
 		style.fontsize = int(style.fontsize * state->ry + 0.5);
 		style.outline_w *= state->ry;
@@ -225,21 +292,70 @@ namespace {
 	}
 }
 
-void ResampleResolution(agi::Context *c) {
-	ResampleSettings settings;
-	AssFile *ass = c->ass.get();
+std::string TransformDrawing(std::string const& drawing, double shift_x, double shift_y, double scale_x, double scale_y) {
+	bool is_x = true;
+	std::string final;
+	final.reserve(drawing.size() + drawing.size() / 4);
+
+	const char *p = drawing.data(), *end = p + drawing.size();
+	while (p != end) {
+		auto token_end = static_cast<const char *>(memchr(p, ' ', end - p));
+		if (!token_end) token_end = end;
+		size_t len = token_end - p;
+
+		double val;
+		bool is_number = len && scan_number(p, token_end) == len;
+		if (is_number)
+			// Stops at the space or the end of the string
+			val = strtod(p, nullptr);
+		else if (len > 1)
+			// Catch the rare spellings such as "inf" which aren't worth
+			// scanning for by hand
+			is_number = agi::util::try_parse(std::string(p, token_end), &val);
+
+		if (is_number) {
+			append_eighths(final, (val + (is_x ? shift_x : shift_y)) * (is_x ? scale_x : scale_y));
+			final += ' ';
+			is_x = !is_x;
+		}
+		else if (len == 1) {
+			char c = tolower(*p);
+			if (c == 'm' || c == 'n' || c == 'l' || c == 'b' || c == 's' || c == 'p' || c == 'c') {
+				is_x = true;
+				final += c;
+				final += ' ';
+			}
+		}
+
+		p = token_end == end ? end : token_end + 1;
+	}
+
+	if (final.size())
+		final.pop_back();
+	return final;
+}
 
+void ResampleResolution(agi::Context *c) {
 	auto provider = c->project->VideoProvider();
 	if (!provider) {
 		throw agi::InvalidInputException("No video loaded");
 	}
 
+	ResampleResolution(c, provider->GetWidth(), provider->GetHeight());
+}
+
+void ResampleResolution(agi::Context *c, int dest_x, int dest_y) {
+	ResampleSettings settings;
+	AssFile *ass = c->ass.get();
+
 	ass->GetResolution(settings.source_x, settings.source_y);
 	settings.source_matrix = MatrixFromString(ass->GetScriptInfo("YCbCr Matrix"));
 
-	settings.dest_x = provider->GetWidth();
-	settings.dest_y = provider->GetHeight();
-	settings.dest_matrix = MatrixFromString(provider->GetRealColorSpace());
+	settings.dest_x = dest_x;
+	settings.dest_y = dest_y;
+	// Without video there's nothing to convert the colors to
+	auto provider = c->project->VideoProvider();
+	settings.dest_matrix = provider ? MatrixFromString(provider->GetRealColorSpace()) : settings.source_matrix;
 
 	settings.ar_mode = ResampleARMode::Stretch;
 	settings.margin[LEFT] = 0;
@@ -304,8 +420,7 @@ void ResampleResolution(agi::Context *c) {
 
 	for (auto& line : ass->Styles)
 		resample_style(&state, line);
-	for (auto& line : ass->Events)
-		resample_line(&state, line);
+	resample_lines(&state, ass->Events);
 
 	ass->SetScriptInfo("PlayResX", std::to_string(settings.dest_x));
 	ass->SetScriptInfo("PlayResY", std::to_string(settings.dest_y));
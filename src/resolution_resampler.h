@@ -44,6 +44,17 @@ YCbCrMatrix MatrixFromString(std::string const& str);
 std::string MatrixToString(YCbCrMatrix mat);
 std::vector<std::string> MatrixNames();
 
+/// Shift and scale the coordinates of an ASS vector drawing, rounding them to
+/// eighth-pixels. Each coordinate becomes (value + shift) * scale, and
+/// anything which is neither a number nor a drawing command is dropped.
+/// @param drawing Drawing commands, separated by spaces
+/// @param shift_x Offset added to each X coordinate before scaling
+/// @param shift_y Offset added to each Y coordinate before scaling
+/// @param scale_x Horizontal scale factor
+/// @param scale_y Vertical scale factor
+/// @return The transformed drawing
+std::string TransformDrawing(std::string const& drawing, double shift_x, double shift_y, double scale_x, double scale_y);
+
 /// Configuration parameters for a resample
 struct ResampleSettings {
 	int margin[4];  ///< Amount to add to each margin
@@ -56,7 +67,13 @@ struct ResampleSettings {
 	YCbCrMatrix dest_matrix;
 };
 
-/// Resample the subtitles in the project
+/// Resample the subtitles in the project to the resolution of the video
 /// @param file Subtitles to resample
-/// @param settings Resample configuration settings
 void ResampleResolution(agi::Context *file);
+
+/// Resample the subtitles in the project to the given resolution, converting
+/// colors to the video's color matrix if video is loaded
+/// @param file Subtitles to resample
+/// @param dest_x New X resolution
+/// @param dest_y New Y resolution
+void ResampleResolution(agi::Context *file, int dest_x, int dest_y);
@@ -0,0 +1,242 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+/// @file text_extents_freetype.cpp
+/// @brief Text measurement with fontconfig, FreeType and HarfBuzz
+/// @ingroup scripting
+///
+
+#ifdef WITH_HARFBUZZ
+#include "text_extents_freetype.h"
+
+#include <libaegisub/log.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/locale/utf.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+#include <fontconfig/fontconfig.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_ADVANCES_H
+#include FT_TRUETYPE_TABLES_H
+#include <hb.h>
+#include <hb-ft.h>
+#include <hb-ot.h>
+
+namespace {
+/// A font face along with the metrics needed to scale it the way GDI does,
+/// all in font units
+struct Face {
+	FT_Face ft = nullptr;
+	hb_font_t *hb = nullptr;
+
+	/// Height the font size refers to: the Windows ascent plus descent
+	double line_height = 0;
+	double descent = 0;
+	double extlead = 0;
+
+	/// Advances of the characters which have been measured on their own
+	std::unordered_map<uint32_t, double> advances;
+
+	~Face() {
+		if (hb) hb_font_destroy(hb);
+		if (ft) FT_Done_Face(ft);
+	}
+
+	double Advance(uint32_t cp) {
+		auto it = advances.find(cp);
+		if (it != advances.end())
+			return it->second;
+
+		FT_Fixed advance = 0;
+		FT_Get_Advance(ft, FT_Get_Char_Index(ft, cp), FT_LOAD_NO_SCALE, &advance);
+		return advances[cp] = static_cast<double>(advance);
+	}
+};
+
+class Engine {
+	FT_Library library = nullptr;
+	hb_buffer_t *buffer = nullptr;
+	/// Faces by lowercased family name, bold and italic. Failed lookups are
+	/// stored as null so that they aren't retried for every call.
+	std::map<std::tuple<std::string, bool, bool>, std::unique_ptr<Face>> faces;
+
+	std::unique_ptr<Face> Load(std::string const& family, bool bold, bool italic);
+
+public:
+	std::mutex lock;
+
+	Engine() {
+		if (FT_Init_FreeType(&library))
+			library = nullptr;
+		buffer = hb_buffer_create();
+	}
+
+	~Engine() {
+		faces.clear();
+		hb_buffer_destroy(buffer);
+		if (library) FT_Done_FreeType(library);
+	}
+
+	Face *Get(std::string const& font, bool bold, bool italic);
+	double Shape(Face *face, std::string const& text);
+};
+
+std::unique_ptr<Face> Engine::Load(std::string const& family, bool bold, bool italic) {
+	if (!library) return nullptr;
+
+	FcPattern *pat = FcPatternCreate();
+	FcPatternAddString(pat, FC_FAMILY, reinterpret_cast<const FcChar8 *>(family.c_str()));
+	FcPatternAddInteger(pat, FC_WEIGHT, bold ? FC_WEIGHT_BOLD : FC_WEIGHT_REGULAR);
+	FcPatternAddInteger(pat, FC_SLANT, italic ? FC_SLANT_ITALIC : FC_SLANT_ROMAN);
+	FcPatternAddBool(pat, FC_OUTLINE, FcTrue);
+	FcConfigSubstitute(nullptr, pat, FcMatchPattern);
+	FcDefaultSubstitute(pat);
+
+	FcResult result;
+	FcPattern *match = FcFontMatch(nullptr, pat, &result);
+	FcPatternDestroy(pat);
+	if (!match) return nullptr;
+
+	std::unique_ptr<Face> face(new Face);
+	FcChar8 *file = nullptr;
+	int index = 0;
+	FcPatternGetInteger(match, FC_INDEX, 0, &index);
+	if (FcPatternGetString(match, FC_FILE, 0, &file) != FcResultMatch
+		|| FT_New_Face(library, reinterpret_cast<const char *>(file), index, &face->ft)) {
+		face->ft = nullptr;
+		FcPatternDestroy(match);
+		return nullptr;
+	}
+	LOG_D("automation/text_extents") << "Using " << file << " for " << family;
+	FcPatternDestroy(match);
+
+	// Scale the font as GDI does, so that the font size is the distance
+	// between the Windows ascent and descent
+	auto ft = face->ft;
+	auto os2 = static_cast<TT_OS2 *>(FT_Get_Sfnt_Table(ft, FT_SFNT_OS2));
+	auto hhea = static_cast<TT_HoriHeader *>(FT_Get_Sfnt_Table(ft, FT_SFNT_HHEA));
+	double ascent;
+	if (os2 && os2->usWinAscent + os2->usWinDescent > 0) {
+		ascent = os2->usWinAscent;
+		face->descent = os2->usWinDescent;
+	}
+	else {
+		ascent = ft->ascender;
+		face->descent = -ft->descender;
+	}
+	face->line_height = ascent + face->descent;
+	if (face->line_height <= 0)
+		face->line_height = ft->units_per_EM;
+
+	// GDI's external leading is whatever the hhea line gap leaves over once
+	// the Windows metrics are taken into account
+	if (hhea) {
+		double gap = hhea->Line_Gap - (face->line_height - (hhea->Ascender - hhea->Descender));
+		face->extlead = gap > 0 ? gap : 0;
+	}
+
+	hb_face_t *hb_face = hb_ft_face_create_referenced(ft);
+	face->hb = hb_font_create(hb_face);
+	hb_face_destroy(hb_face);
+	// Work in unscaled font units using the metrics tables directly
+	hb_ot_font_set_funcs(face->hb);
+	hb_font_set_scale(face->hb, ft->units_per_EM, ft->units_per_EM);
+
+	return face;
+}
+
+Face *Engine::Get(std::string const& font, bool bold, bool italic) {
+	// Vertical fonts are measured as their horizontal counterparts
+	std::string family = font.size() > 1 && font[0] == '@' ? font.substr(1) : font;
+	boost::to_lower(family);
+
+	auto key = std::make_tuple(family, bold, italic);
+	auto it = faces.find(key);
+	if (it == faces.end())
+		it = faces.emplace(key, Load(family, bold, italic)).first;
+	return it->second.get();
+}
+
+double Engine::Shape(Face *face, std::string const& text) {
+	hb_buffer_clear_contents(buffer);
+	hb_buffer_add_utf8(buffer, text.data(), static_cast<int>(text.size()), 0, static_cast<int>(text.size()));
+	hb_buffer_guess_segment_properties(buffer);
+	hb_shape(face->hb, buffer, nullptr, 0);
+
+	unsigned int count = 0;
+	auto positions = hb_buffer_get_glyph_positions(buffer, &count);
+	double width = 0;
+	for (unsigned int i = 0; i < count; ++i)
+		width += positions[i].x_advance;
+	return width;
+}
+
+Engine& engine() {
+	static Engine engine;
+	return engine;
+}
+}
+
+namespace Automation4 {
+bool FreeTypeTextExtents(std::string const& font, double size, bool bold, bool italic, double spacing,
+	std::string const& text, double &width, double &height, double &descent, double &extlead)
+{
+	auto& e = engine();
+	std::lock_guard<std::mutex> guard(e.lock);
+
+	Face *face = e.Get(font, bold, italic);
+	if (!face) return false;
+
+	using utf = boost::locale::utf::utf_traits<char>;
+	auto begin = text.begin(), end = text.end();
+	uint32_t cp = begin == end ? boost::locale::utf::illegal : utf::decode(begin, end);
+
+	double units = 0;
+	if (spacing != 0) {
+		// Measure each character on its own, without kerning, as the
+		// system measurement does
+		size_t chars = 0;
+		for (auto it = text.begin(); it != end; ++chars) {
+			auto c = utf::decode(it, end);
+			if (c != boost::locale::utf::illegal && c != boost::locale::utf::incomplete)
+				units += face->Advance(c);
+		}
+		width = units * size / face->line_height + spacing * chars;
+	}
+	else {
+		// A lone character needs no shaping, and is what karaoke templates
+		// measure most often
+		if (begin == end && cp != boost::locale::utf::illegal && cp != boost::locale::utf::incomplete)
+			units = face->Advance(cp);
+		else if (!text.empty())
+			units = e.Shape(face, text);
+		width = units * size / face->line_height;
+	}
+
+	height = size;
+	descent = face->descent * size / face->line_height;
+	extlead = face->extlead * size / face->line_height;
+	return true;
+}
+}
+#endif // WITH_HARFBUZZ
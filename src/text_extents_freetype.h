@@ -0,0 +1,40 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+
+/// @file text_extents_freetype.h
+/// @brief Text measurement with fontconfig, FreeType and HarfBuzz
+/// @ingroup scripting
+///
+
+#include <string>
+
+namespace Automation4 {
+	/// @brief Measure text without going through the GUI toolkit
+	/// @param font Font family name
+	/// @param size Font size; the results are in the same units
+	/// @param bold, italic Style of the face to look up
+	/// @param spacing Extra space after each character. When non-zero, kerning
+	///                is not applied, as with the system measurement
+	/// @param text UTF-8 text to measure
+	/// @return false if no usable font file could be loaded
+	///
+	/// Faces are looked up with fontconfig once per family and style, and the
+	/// advances of characters measured one at a time are cached per face.
+	/// Everything else is shaped with HarfBuzz.
+	bool FreeTypeTextExtents(std::string const& font, double size, bool bold, bool italic, double spacing,
+		std::string const& text, double &width, double &height, double &descent, double &extlead);
+}
@@ -16,22 +16,226 @@
 
 #include "video_frame.h"
 
-#if (BOOST_VERSION / 100000) <= 1 && ((BOOST_VERSION / 100) % 1000) <= 67
-#include <boost/gil/gil_all.hpp>
-#else
-#include <boost/gil.hpp>
+#include <cstring>
+
+#include <libaegisub/exception.h>
+#include <libaegisub/ycbcr_conv.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VIDEO_FRAME_SSE2
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
 #endif
 
 namespace {
-	// We actually have bgr_, not bgra, so we need a custom converter which ignores the alpha channel
-	struct color_converter {
-		template <typename P1, typename P2>
-		void operator()(P1 const& src, P2& dst) const {
-			using namespace boost::gil;
-			dst = rgb8_pixel_t(
-				get_color(src, red_t()),
-				get_color(src, green_t()),
-				get_color(src, blue_t()));
+	/// Copy a row of BGRA pixels to packed RGB
+	void bgra_to_rgb(const unsigned char *src, unsigned char *dst, size_t count) {
+		size_t i = 0;
+#ifdef __SSSE3__
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+		// Each store writes 16 bytes for 12 bytes of pixels, so stop while
+		// there's still room for the excess
+		for (; i + 6 <= count; i += 4) {
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 3), _mm_shuffle_epi8(px, shuffle));
+		}
+#endif
+		for (; i < count; ++i) {
+			dst[i * 3] = src[i * 4 + 2];
+			dst[i * 3 + 1] = src[i * 4 + 1];
+			dst[i * 3 + 2] = src[i * 4];
+		}
+	}
+
+	/// Copy a row of gray pixels to packed RGB
+	void gray_to_rgb(const unsigned char *src, unsigned char *dst, size_t count) {
+		for (size_t i = 0; i < count; ++i)
+			dst[i * 3] = dst[i * 3 + 1] = dst[i * 3 + 2] = src[i];
+	}
+
+	/// Average 2x2 blocks of a row pair of an 8-bit plane with bpp
+	/// interleaved channels (1 or 4)
+	/// @param width Width of the source rows in pixels
+	/// @param out_width Number of pixels to write, at most ceil(width / 2).
+	///                  An odd last column is averaged with itself.
+	void downsample_row(const unsigned char *r0, const unsigned char *r1, unsigned char *dst, size_t width, size_t out_width, int bpp) {
+		size_t x = 0;
+#ifdef VIDEO_FRAME_SSE2
+		auto load = [](const unsigned char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+		const __m128i zero = _mm_setzero_si128();
+		size_t whole = std::min(out_width, width / 2);
+
+		if (bpp == 1) {
+			// 16 source bytes from each row to 8 averages as 16-bit words
+			const __m128i ones = _mm_set1_epi16(1), two = _mm_set1_epi32(2);
+			auto average = [&](__m128i a, __m128i b) {
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, ones), two), 2);
+				hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, ones), two), 2);
+				return _mm_packs_epi32(lo, hi);
+			};
+			for (; x + 16 <= whole; x += 16) {
+				__m128i a = average(load(r0 + x * 2), load(r1 + x * 2));
+				__m128i b = average(load(r0 + x * 2 + 16), load(r1 + x * 2 + 16));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(a, b));
+			}
 		}
-	};
+		else if (bpp == 4) {
+			// 4 source pixels from each row to 2 averaged pixels as 16-bit words
+			const __m128i two = _mm_set1_epi16(2);
+			auto average = [&](__m128i a, __m128i b) {
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				return _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			};
+			for (; x + 4 <= whole; x += 4) {
+				__m128i a = average(load(r0 + x * 8), load(r1 + x * 8));
+				__m128i b = average(load(r0 + x * 8 + 16), load(r1 + x * 8 + 16));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), _mm_packus_epi16(a, b));
+			}
+		}
+#endif
+		for (; x < out_width; ++x) {
+			size_t x0 = x * 2 * bpp;
+			size_t x1 = std::min(x * 2 + 1, width - 1) * bpp;
+			for (int c = 0; c < bpp; ++c)
+				dst[x * bpp + c] = (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2;
+		}
+	}
+
+	/// Downsample a whole plane into a tightly packed buffer
+	void downsample_plane(VideoFrame const& src, int plane, unsigned char *dst, size_t out_width, size_t out_height, int bpp) {
+		size_t width = src.PlaneWidth(plane), height = src.PlaneHeight(plane);
+		size_t pitch = src.PlanePitch(plane);
+		auto data = src.Plane(plane);
+		for (size_t y = 0; y < out_height; ++y) {
+			auto r0 = data + y * 2 * pitch;
+			auto r1 = data + std::min(y * 2 + 1, height - 1) * pitch;
+			downsample_row(r0, r1, dst + y * out_width * bpp, width, out_width, bpp);
+		}
+	}
+}
+
+const unsigned char *VideoFrame::Plane(int plane) const {
+	if (borrowed[0])
+		return borrowed[plane];
+	return data.data() + (plane ? chroma_offset[plane - 1] : 0);
+}
+
+size_t VideoFrame::PlaneHeight(int plane) const {
+	if (!plane) return height;
+	return (height + (1 << chroma_shift_h) - 1) >> chroma_shift_h;
+}
+
+size_t VideoFrame::PlaneWidth(int plane) const {
+	if (!plane) return width;
+	return (width + (1 << chroma_shift_w) - 1) >> chroma_shift_w;
+}
+
+void VideoFrame::Own() {
+	if (!borrowed[0]) return;
+
+	size_t luma_size = pitch * height;
+	size_t chroma_size = format == Format::YUV ? chroma_pitch * PlaneHeight(1) : 0;
+	data.resize(luma_size + chroma_size * 2);
+	memcpy(&data[0], borrowed[0], luma_size);
+	if (chroma_size) {
+		chroma_offset[0] = luma_size;
+		chroma_offset[1] = luma_size + chroma_size;
+		memcpy(&data[chroma_offset[0]], borrowed[1], chroma_size);
+		memcpy(&data[chroma_offset[1]], borrowed[2], chroma_size);
+	}
+	borrowed[0] = borrowed[1] = borrowed[2] = nullptr;
+}
+
+void VideoFrame::ViewOf(VideoFrame const& frame) {
+	data.clear();
+	width = frame.width;
+	height = frame.height;
+	pitch = frame.pitch;
+	flipped = frame.flipped;
+	format = frame.format;
+	chroma_shift_w = frame.chroma_shift_w;
+	chroma_shift_h = frame.chroma_shift_h;
+	chroma_pitch = frame.chroma_pitch;
+	for (int i = 0; i < 3; ++i)
+		borrowed[i] = i < frame.PlaneCount() ? frame.Plane(i) : nullptr;
+}
+
+std::vector<unsigned char> GetRGB(VideoFrame const& frame) {
+	if (frame.format == VideoFrame::Format::YUV)
+		throw agi::InvalidInputException("Converting YUV frames to RGB is not supported");
+
+	std::vector<unsigned char> rgb(frame.width * frame.height * 3);
+	for (size_t y = 0; y < frame.height; ++y) {
+		size_t src_y = frame.flipped ? frame.height - y - 1 : y;
+		auto src = frame.Plane(0) + src_y * frame.pitch;
+		if (frame.format == VideoFrame::Format::BGRA)
+			bgra_to_rgb(src, &rgb[y * frame.width * 3], frame.width);
+		else
+			gray_to_rgb(src, &rgb[y * frame.width * 3], frame.width);
+	}
+	return rgb;
+}
+
+VideoFrame ConvertToYCbCr(VideoFrame const& frame, agi::ycbcr_matrix matrix, agi::ycbcr_range range) {
+	if (frame.format != VideoFrame::Format::BGRA)
+		throw agi::InvalidInputException("Only BGRA frames can be converted to YUV");
+
+	VideoFrame out;
+	out.width = frame.width;
+	out.height = frame.height;
+	out.pitch = out.chroma_pitch = frame.width;
+	out.flipped = frame.flipped;
+	out.format = VideoFrame::Format::YUV;
+
+	size_t plane_size = out.width * out.height;
+	out.data.resize(plane_size * 3);
+	out.chroma_offset[0] = plane_size;
+	out.chroma_offset[1] = plane_size * 2;
+
+	agi::ycbcr_converter conv(matrix, range);
+	auto src = frame.Plane(0);
+	auto dst = &out.data[0];
+	for (size_t y = 0; y < frame.height; ++y) {
+		size_t offset = y * out.width;
+		conv.bgra_to_ycbcr(src + y * frame.pitch, frame.width,
+			dst + offset, dst + plane_size + offset, dst + plane_size * 2 + offset);
+	}
+	return out;
+}
+
+VideoFrame Downsample(VideoFrame const& frame) {
+	VideoFrame out;
+	out.width = std::max<size_t>(1, frame.width / 2);
+	out.height = std::max<size_t>(1, frame.height / 2);
+	out.flipped = frame.flipped;
+	out.format = frame.format;
+	out.chroma_shift_w = frame.chroma_shift_w;
+	out.chroma_shift_h = frame.chroma_shift_h;
+
+	int bpp = frame.format == VideoFrame::Format::BGRA ? 4 : 1;
+	out.pitch = out.width * bpp;
+	size_t luma_size = out.pitch * out.height;
+	size_t chroma_size = 0;
+	if (frame.format == VideoFrame::Format::YUV) {
+		out.chroma_pitch = out.PlaneWidth(1);
+		chroma_size = out.chroma_pitch * out.PlaneHeight(1);
+	}
+
+	out.data.resize(luma_size + chroma_size * 2);
+	downsample_plane(frame, 0, &out.data[0], out.width, out.height, bpp);
+	if (chroma_size) {
+		out.chroma_offset[0] = luma_size;
+		out.chroma_offset[1] = luma_size + chroma_size;
+		for (int plane = 1; plane < 3; ++plane)
+			downsample_plane(frame, plane, &out.data[out.chroma_offset[plane - 1]], out.PlaneWidth(plane), out.PlaneHeight(plane), 1);
+	}
+	return out;
 }
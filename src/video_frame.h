@@ -14,12 +14,74 @@
 //
 // Aegisub Project http://www.aegisub.org/
 
+#include <cstddef>
 #include <vector>
 
+namespace agi { enum class ycbcr_matrix; enum class ycbcr_range; }
+
 struct VideoFrame {
+	/// Layout of the pixel data
+	enum class Format {
+		BGRA, ///< Packed 8-bit B, G, R, X
+		Gray, ///< 8-bit luma plane only
+		YUV   ///< 8-bit planar Y, U and V, with possibly subsampled chroma
+	};
+
 	std::vector<unsigned char> data;
 	size_t width;
 	size_t height;
 	size_t pitch;
 	bool flipped;
+
+	Format format = Format::BGRA;
+
+	/// Chroma subsampling of YUV frames, as log2 of the horizontal and
+	/// vertical subsampling factors
+	int chroma_shift_w = 0;
+	int chroma_shift_h = 0;
+	/// Pitch of the U and V planes of YUV frames
+	size_t chroma_pitch = 0;
+	/// Offsets of the U and V planes of YUV frames within data
+	size_t chroma_offset[2] = {0, 0};
+
+	/// If non-null, the planes live in buffers owned by the video provider
+	/// rather than in data. Such frames are only valid until the next frame
+	/// is requested from the provider.
+	const unsigned char *borrowed[3] = {nullptr, nullptr, nullptr};
+
+	/// Number of planes in this frame's format
+	int PlaneCount() const { return format == Format::YUV ? 3 : 1; }
+
+	/// Get a pointer to the first row of the given plane
+	const unsigned char *Plane(int plane) const;
+
+	/// Get the pitch of the given plane in bytes
+	size_t PlanePitch(int plane) const { return plane ? chroma_pitch : pitch; }
+
+	/// Get the height of the given plane in rows
+	size_t PlaneHeight(int plane) const;
+
+	/// Get the width of the given plane in pixels
+	size_t PlaneWidth(int plane) const;
+
+	/// Copy borrowed planes into data so that the frame can outlive the call
+	/// which produced it
+	void Own();
+
+	/// Make this frame a borrowed view of another frame's pixel data, which
+	/// must outlive it
+	void ViewOf(VideoFrame const& frame);
 };
+
+/// @brief Convert a BGRA or gray frame to packed 8-bit RGB
+/// @return width * height * 3 bytes, top row first
+std::vector<unsigned char> GetRGB(VideoFrame const& frame);
+
+/// Convert a BGRA frame to an unsubsampled YUV frame with the given matrix
+VideoFrame ConvertToYCbCr(VideoFrame const& frame, agi::ycbcr_matrix matrix, agi::ycbcr_range range);
+
+/// @brief Halve the size of a frame by averaging each 2x2 block of pixels
+///
+/// Odd trailing rows and columns are dropped. YUV frames keep their chroma
+/// subsampling.
+VideoFrame Downsample(VideoFrame const& frame);
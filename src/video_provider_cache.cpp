@@ -54,6 +54,7 @@ public:
 	VideoProviderCache(std::unique_ptr<VideoProvider> master) : master(std::move(master)) { }
 
 	void GetFrame(int n, VideoFrame &frame) override;
+	void GetFrameView(int n, VideoFrame &frame) override;
 
 	void SetColorSpace(std::string const& m) override {
 		cache.clear();
@@ -97,6 +98,18 @@ void VideoProviderCache::GetFrame(int n, VideoFrame &out) {
 	else
 		cache.emplace_front(out, n);
 }
+
+void VideoProviderCache::GetFrameView(int n, VideoFrame &out) {
+	for (auto const& cached : cache) {
+		if (cached.frame_number == n) {
+			out.ViewOf(cached.frame);
+			return;
+		}
+	}
+
+	// Views are short-lived, so don't bother caching them
+	master->GetFrameView(n, out);
+}
 }
 
 std::unique_ptr<VideoProvider> CreateCacheVideoProvider(std::unique_ptr<VideoProvider> parent) {
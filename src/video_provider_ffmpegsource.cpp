@@ -44,6 +44,8 @@
 #include <libaegisub/log.h>
 #include <libaegisub/make_unique.h>
 
+#include <cstring>
+
 namespace {
 typedef enum AGI_ColorSpaces {
 	AGI_CS_RGB = 0,
@@ -71,6 +73,11 @@ class FFmpegSourceVideoProvider final : public VideoProvider, FFmpegSourceProvid
 
 	int Width = -1;                 ///< width in pixels
 	int Height = -1;                ///< height in pixels
+	int OutWidth = -1;              ///< width of output frames in pixels
+	int OutHeight = -1;             ///< height of output frames in pixels
+	VideoFrame::Format OutFormat = VideoFrame::Format::BGRA; ///< format of output frames
+	int ChromaShiftW = 0;           ///< horizontal chroma subsampling of YUV output
+	int ChromaShiftH = 0;           ///< vertical chroma subsampling of YUV output
 	int CS = -1;                    ///< Reported colorspace of first frame
 	int CR = -1;                    ///< Reported colorrange of first frame
 	double DAR;                     ///< display aspect ratio
@@ -84,11 +91,14 @@ class FFmpegSourceVideoProvider final : public VideoProvider, FFmpegSourceProvid
 	bool has_audio = false;
 
 	void LoadVideo(agi::fs::path const& filename, std::string const& colormatrix);
+	void SetOutputFormat();
+	const FFMS_Frame *DecodeFrame(int n, VideoFrame &out);
 
 public:
 	FFmpegSourceVideoProvider(agi::fs::path const& filename, std::string const& colormatrix, agi::BackgroundRunner *br);
 
 	void GetFrame(int n, VideoFrame &out) override;
+	void GetFrameView(int n, VideoFrame &out) override;
 
 	void SetColorSpace(std::string const& matrix) override {
 		if (matrix == ColorSpace) return;
@@ -263,9 +273,7 @@ void FFmpegSourceVideoProvider::LoadVideo(agi::fs::path const& filename, std::st
 			throw VideoOpenError(std::string("Failed to set input format: ") + ErrInfo.Buffer);
 	}
 
-	const int TargetFormat[] = { FFMS_GetPixFmt("bgra"), -1 };
-	if (FFMS_SetOutputFormatV2(VideoSource, TargetFormat, Width, Height, FFMS_RESIZER_BICUBIC, &ErrInfo))
-		throw VideoOpenError(std::string("Failed to set output format: ") + ErrInfo.Buffer);
+	SetOutputFormat();
 
 	// get frame info data
 	FFMS_Track *FrameData = FFMS_GetTrackFromVideo(VideoSource);
@@ -296,18 +304,108 @@ void FFmpegSourceVideoProvider::LoadVideo(agi::fs::path const& filename, std::st
 		Timecodes = agi::vfr::Framerate(TimecodesVector);
 }
 
-void FFmpegSourceVideoProvider::GetFrame(int n, VideoFrame &out) {
+void FFmpegSourceVideoProvider::SetOutputFormat() {
+	auto format = OPT_GET("Provider/Video/FFmpegSource/Output Format")->GetString();
+	if (format == "yuv")
+		OutFormat = VideoFrame::Format::YUV;
+	else if (format == "gray")
+		OutFormat = VideoFrame::Format::Gray;
+	else
+		OutFormat = VideoFrame::Format::BGRA;
+
+	// Scale to the requested size, filling in a missing dimension from the
+	// aspect ratio of the video
+	OutWidth = OPT_GET("Provider/Video/FFmpegSource/Output Width")->GetInt();
+	OutHeight = OPT_GET("Provider/Video/FFmpegSource/Output Height")->GetInt();
+	if (OutWidth <= 0 && OutHeight <= 0) {
+		OutWidth = Width;
+		OutHeight = Height;
+	}
+	else if (OutWidth <= 0)
+		OutWidth = std::max(1, (int)((int64_t)Width * OutHeight / Height));
+	else if (OutHeight <= 0)
+		OutHeight = std::max(1, (int)((int64_t)Height * OutWidth / Width));
+
+	std::vector<int> TargetFormats;
+	switch (OutFormat) {
+		case VideoFrame::Format::BGRA:
+			TargetFormats.push_back(FFMS_GetPixFmt("bgra"));
+			break;
+		case VideoFrame::Format::Gray:
+			TargetFormats.push_back(FFMS_GetPixFmt("gray"));
+			break;
+		case VideoFrame::Format::YUV:
+			// FFMS picks whichever of these loses the least from the source
+			// format, which for most video means no conversion at all
+			TargetFormats.push_back(FFMS_GetPixFmt("yuv420p"));
+			TargetFormats.push_back(FFMS_GetPixFmt("yuv422p"));
+			TargetFormats.push_back(FFMS_GetPixFmt("yuv444p"));
+			break;
+	}
+	TargetFormats.push_back(-1);
+
+	int Resizer = OutWidth < Width || OutHeight < Height ? FFMS_RESIZER_AREA : FFMS_RESIZER_BICUBIC;
+	if (FFMS_SetOutputFormatV2(VideoSource, TargetFormats.data(), OutWidth, OutHeight, Resizer, &ErrInfo))
+		throw VideoOpenError(std::string("Failed to set output format: ") + ErrInfo.Buffer);
+
+	if (OutFormat != VideoFrame::Format::YUV)
+		return;
+
+	const FFMS_Frame *TempFrame = FFMS_GetFrame(VideoSource, 0, &ErrInfo);
+	if (!TempFrame)
+		throw VideoOpenError(std::string("Failed to decode first frame: ") + ErrInfo.Buffer);
+
+	if (TempFrame->ConvertedPixelFormat == FFMS_GetPixFmt("yuv420p"))
+		ChromaShiftW = ChromaShiftH = 1;
+	else if (TempFrame->ConvertedPixelFormat == FFMS_GetPixFmt("yuv422p"))
+		ChromaShiftW = 1;
+}
+
+const FFMS_Frame *FFmpegSourceVideoProvider::DecodeFrame(int n, VideoFrame &out) {
 	n = mid(0, n, GetFrameCount() - 1);
 
 	auto frame = FFMS_GetFrame(VideoSource, n, &ErrInfo);
 	if (!frame)
 		throw VideoDecodeError(std::string("Failed to retrieve frame: ") +  ErrInfo.Buffer);
 
-	out.data.assign(frame->Data[0], frame->Data[0] + frame->Linesize[0] * Height);
 	out.flipped = false;
-	out.width = Width;
-	out.height = Height;
+	out.width = OutWidth;
+	out.height = OutHeight;
 	out.pitch = frame->Linesize[0];
+	out.format = OutFormat;
+	out.chroma_shift_w = ChromaShiftW;
+	out.chroma_shift_h = ChromaShiftH;
+	out.chroma_pitch = OutFormat == VideoFrame::Format::YUV ? frame->Linesize[1] : 0;
+	return frame;
+}
+
+void FFmpegSourceVideoProvider::GetFrame(int n, VideoFrame &out) {
+	auto frame = DecodeFrame(n, out);
+
+	out.borrowed[0] = out.borrowed[1] = out.borrowed[2] = nullptr;
+	size_t luma_size = frame->Linesize[0] * OutHeight;
+	if (OutFormat != VideoFrame::Format::YUV) {
+		out.data.assign(frame->Data[0], frame->Data[0] + luma_size);
+		return;
+	}
+
+	size_t chroma_size = frame->Linesize[1] * out.PlaneHeight(1);
+	out.data.resize(luma_size + chroma_size * 2);
+	out.chroma_offset[0] = luma_size;
+	out.chroma_offset[1] = luma_size + chroma_size;
+	memcpy(&out.data[0], frame->Data[0], luma_size);
+	memcpy(&out.data[out.chroma_offset[0]], frame->Data[1], chroma_size);
+	memcpy(&out.data[out.chroma_offset[1]], frame->Data[2], chroma_size);
+}
+
+void FFmpegSourceVideoProvider::GetFrameView(int n, VideoFrame &out) {
+	auto frame = DecodeFrame(n, out);
+
+	// The frame returned by FFMS stays valid until the next FFMS_GetFrame
+	// call, which is all that views promise
+	out.data.clear();
+	for (int i = 0; i < 3; ++i)
+		out.borrowed[i] = i < out.PlaneCount() ? frame->Data[i] : nullptr;
 }
 }
 
@@ -44,14 +44,64 @@
 #include <libaegisub/ycbcr_conv.h>
 
 #include <boost/algorithm/string/case_conv.hpp>
+#include <climits>
+#include <cstring>
 #include <memory>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 /// the maximum allowed header length, in bytes
 #define YUV4MPEG_HEADER_MAXLEN 128
+/// the length of a frame header with no parameters, i.e. "FRAME\n"
+#define YUV4MPEG_FRAME_HEADER_LEN 6
 
 namespace {
 
+/// Reduce a row of little-endian samples of the given bit depth to 8 bits
+void narrow_row(const unsigned char *src, size_t count, int depth, uint8_t *dst) {
+	int shift = depth - 8;
+	size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128i round = _mm_set1_epi16(static_cast<int16_t>(1 << (shift - 1)));
+	const __m128i shift_count = _mm_cvtsi32_si128(shift);
+	for (; i + 16 <= count; i += 16) {
+		__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2 + 16));
+		lo = _mm_srl_epi16(_mm_adds_epu16(lo, round), shift_count);
+		hi = _mm_srl_epi16(_mm_adds_epu16(hi, round), shift_count);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		int v = ((src[i * 2] | src[i * 2 + 1] << 8) + (1 << (shift - 1))) >> shift;
+		dst[i] = static_cast<uint8_t>(v > 255 ? 255 : v);
+	}
+}
+
+/// Stretch a row of horizontally subsampled chroma to the given width by
+/// repeating each sample
+void widen_row(const uint8_t *src, int shift, size_t width, uint8_t *dst) {
+	size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	if (shift == 1) {
+		for (; i + 32 <= width; i += 32) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i / 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi8(v, v));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 16), _mm_unpackhi_epi8(v, v));
+		}
+	}
+#endif
+
+	for (; i < width; ++i)
+		dst[i] = src[i >> shift];
+}
+
 /// @class YUV4MPEGVideoProvider
 /// @brief Implements reading of YUV4MPEG uncompressed video files
 class YUV4MPEGVideoProvider final : public VideoProvider {
@@ -115,9 +165,12 @@ class YUV4MPEGVideoProvider final : public VideoProvider {
 
 	int w = 0, h = 0;	/// frame width/height
 	int num_frames = -1; /// length of file in frames
-	int frame_sz;	/// size of each frame in bytes
-	int luma_sz;	/// size of the luma plane of each frame, in bytes
-	int chroma_sz;	/// size of one of the two chroma planes of each frame, in bytes
+	uint64_t frame_sz;	/// size of each frame in bytes
+	uint64_t luma_sz;	/// size of the luma plane of each frame, in bytes
+	uint64_t chroma_sz;	/// size of one of the two chroma planes of each frame, in bytes
+	int chroma_w = 0, chroma_h = 0;	/// dimensions of the chroma planes
+	int chroma_shift_w = 0, chroma_shift_h = 0;	/// log2 of the chroma subsampling factors
+	int bit_depth = 8;	/// bits per sample; samples wider than 8 bits take two bytes
 
 	Y4M_PixelFormat pixfmt = Y4M_PIXFMT_NONE;		/// colorspace/pixel format
 	Y4M_InterlacingMode imode = Y4M_ILACE_NOTSET;	/// interlacing mode (for the entire stream)
@@ -132,12 +185,20 @@ class YUV4MPEGVideoProvider final : public VideoProvider {
 
 	/// a list of byte positions detailing where in the file
 	/// each frame header can be found
+	/// Empty if every frame has a bare FRAME header, in which case the
+	/// positions are computed from first_frame instead
 	std::vector<uint64_t> seek_table;
+	uint64_t first_frame = 0;	/// byte position of the first frame's data
+
+	uint64_t FrameOffset(int n) const {
+		return seek_table.empty() ? first_frame + n * (frame_sz + YUV4MPEG_FRAME_HEADER_LEN) : seek_table[n];
+	}
 
 	void ParseFileHeader(const std::vector<std::string>& tags);
 	Y4M_FrameFlags ParseFrameHeader(const std::vector<std::string>& tags);
 	std::vector<std::string> ReadHeader(uint64_t &startpos);
 	int IndexFile(uint64_t pos);
+	int CountFixedFrames(uint64_t pos);
 
 public:
 	YUV4MPEGVideoProvider(agi::fs::path const& filename);
@@ -181,20 +242,35 @@ YUV4MPEGVideoProvider::YUV4MPEGVideoProvider(agi::fs::path const& filename)
 	if (imode == Y4M_ILACE_NOTSET)
 		imode = Y4M_ILACE_UNKNOWN;
 
-	luma_sz = w * h;
 	switch (pixfmt) {
 	case Y4M_PIXFMT_420JPEG:
 	case Y4M_PIXFMT_420MPEG2:
 	case Y4M_PIXFMT_420PALDV:
-		chroma_sz	= (w * h) >> 2; break;
+		chroma_shift_w = chroma_shift_h = 1; break;
+	case Y4M_PIXFMT_411:
+		chroma_shift_w = 2; break;
+	case Y4M_PIXFMT_422:
+		chroma_shift_w = 1; break;
 	default:
-		/// @todo add support for more pixel formats
-		throw VideoOpenError("Unsupported pixel format");
+		break;
+	}
+	if (pixfmt != Y4M_PIXFMT_MONO) {
+		chroma_w = (w + (1 << chroma_shift_w) - 1) >> chroma_shift_w;
+		chroma_h = (h + (1 << chroma_shift_h) - 1) >> chroma_shift_h;
 	}
-	frame_sz	= luma_sz + chroma_sz*2;
 
-	num_frames = IndexFile(pos);
-	if (num_frames <= 0 || seek_table.empty())
+	int sample_sz = bit_depth > 8 ? 2 : 1;
+	luma_sz = uint64_t(w) * h * sample_sz;
+	chroma_sz = uint64_t(chroma_w) * chroma_h * sample_sz;
+	frame_sz = luma_sz + chroma_sz * 2;
+	if (pixfmt == Y4M_PIXFMT_444ALPHA)
+		frame_sz += luma_sz;
+
+	first_frame = pos + YUV4MPEG_FRAME_HEADER_LEN;
+	num_frames = CountFixedFrames(pos);
+	if (num_frames <= 0)
+		num_frames = IndexFile(pos);
+	if (num_frames <= 0)
 		throw VideoOpenError("Unable to determine file length");
 }
 
@@ -251,6 +327,7 @@ void YUV4MPEGVideoProvider::ParseFileHeader(const std::vector<std::string>& tags
 	int t_fps_den	= -1;
 	Y4M_InterlacingMode t_imode	= Y4M_ILACE_NOTSET;
 	Y4M_PixelFormat t_pixfmt	= Y4M_PIXFMT_NONE;
+	int t_depth		= 8;
 
 	for (unsigned i = 1; i < tags.size(); i++) {
 		char type = tags[i][0];
@@ -278,6 +355,18 @@ void YUV4MPEGVideoProvider::ParseFileHeader(const std::vector<std::string>& tags
 			// technically this should probably be case sensitive,
 			// but being liberal in what you accept doesn't hurt
 			boost::to_lower(tag);
+
+			// High bit depth formats are written as e.g. 420p10 or mono16
+			size_t depth_pos = tag.find_last_not_of("0123456789") + 1;
+			if (depth_pos > 0 && depth_pos < tag.size()) {
+				size_t name_len = tag[depth_pos - 1] == 'p' ? depth_pos - 1 : depth_pos;
+				if (name_len == 3 || tag.compare(0, name_len, "mono") == 0) {
+					if (!agi::util::try_parse(tag.substr(depth_pos), &t_depth) || t_depth < 8 || t_depth > 16)
+						err = "invalid bit depth";
+					tag.erase(name_len);
+				}
+			}
+
 			if (tag == "420")			t_pixfmt = Y4M_PIXFMT_420JPEG; // is this really correct?
 			else if (tag == "420jpeg")	t_pixfmt = Y4M_PIXFMT_420JPEG;
 			else if (tag == "420mpeg2")	t_pixfmt = Y4M_PIXFMT_420MPEG2;
@@ -287,7 +376,7 @@ void YUV4MPEGVideoProvider::ParseFileHeader(const std::vector<std::string>& tags
 			else if (tag == "444")		t_pixfmt = Y4M_PIXFMT_444;
 			else if (tag == "444alpha")	t_pixfmt = Y4M_PIXFMT_444ALPHA;
 			else if (tag == "mono")		t_pixfmt = Y4M_PIXFMT_MONO;
-			else
+			else if (!err)
 				err = "invalid or unknown colorspace";
 		}
 		else if (type == 'I') {
@@ -319,7 +408,7 @@ void YUV4MPEGVideoProvider::ParseFileHeader(const std::vector<std::string>& tags
 			err = "illegal height change";
 		if ((t_fps_num > 0 && t_fps_den > 0) && (t_fps_num != fps_rat.num || t_fps_den != fps_rat.den))
 			err = "illegal framerate change";
-		if (t_pixfmt != Y4M_PIXFMT_NONE && t_pixfmt != pixfmt)
+		if (t_pixfmt != Y4M_PIXFMT_NONE && (t_pixfmt != pixfmt || t_depth != bit_depth))
 			err = "illegal colorspace change";
 		if (t_imode != Y4M_ILACE_NOTSET && t_imode != imode)
 			err = "illegal interlacing mode change";
@@ -332,6 +421,7 @@ void YUV4MPEGVideoProvider::ParseFileHeader(const std::vector<std::string>& tags
 		fps_rat.num = t_fps_num;
 		fps_rat.den = t_fps_den;
 		pixfmt		= t_pixfmt	!= Y4M_PIXFMT_NONE	? t_pixfmt	: Y4M_PIXFMT_420JPEG;
+		bit_depth	= t_depth;
 		imode		= t_imode	!= Y4M_ILACE_NOTSET	? t_imode	: Y4M_ILACE_UNKNOWN;
 		fps = double(fps_rat.num) / fps_rat.den;
 		inited = true;
@@ -350,6 +440,31 @@ YUV4MPEGVideoProvider::Y4M_FrameFlags YUV4MPEGVideoProvider::ParseFrameHeader(co
 	throw VideoOpenError("ParseFrameHeader: malformed frame header (bad magic)");
 }
 
+/// @brief Count the frames in the file without reading every frame header
+/// @param pos The byte position of the first frame header
+/// @return The number of frames, or 0 if the file has to be indexed
+/// If every frame header is a bare FRAME with no parameters and there are no
+/// repeated file headers, frames are all the same distance apart and their
+/// positions can be computed rather than looked up. Only a sample of the
+/// headers is checked here; GetFrame() checks the rest as they are read.
+int YUV4MPEGVideoProvider::CountFixedFrames(uint64_t pos) {
+	uint64_t stride = frame_sz + YUV4MPEG_FRAME_HEADER_LEN;
+	if (pos >= file.size() || (file.size() - pos) % stride)
+		return 0;
+
+	uint64_t count = (file.size() - pos) / stride;
+	if (count > INT_MAX)
+		return 0;
+
+	// Includes both the first and the last frame
+	for (uint64_t i = 0; i < 16; ++i) {
+		if (memcmp(file.read(pos + i * (count - 1) / 15 * stride, YUV4MPEG_FRAME_HEADER_LEN), "FRAME\n", YUV4MPEG_FRAME_HEADER_LEN))
+			return 0;
+	}
+
+	return static_cast<int>(count);
+}
+
 /// @brief Indexes the file
 /// @return The number of frames found in the file
 /// This function goes through the file, finds and parses all file and frame headers,
@@ -390,33 +505,58 @@ int YUV4MPEGVideoProvider::IndexFile(uint64_t pos) {
 void YUV4MPEGVideoProvider::GetFrame(int n, VideoFrame &frame) {
 	n = mid(0, n, num_frames - 1);
 
-	int uv_width = w / 2;
+	const char *data;
+	if (seek_table.empty()) {
+		data = file.read(FrameOffset(n) - YUV4MPEG_FRAME_HEADER_LEN, frame_sz + YUV4MPEG_FRAME_HEADER_LEN);
+		if (memcmp(data, "FRAME\n", YUV4MPEG_FRAME_HEADER_LEN))
+			throw VideoDecodeError("Malformed frame header in YUV4MPEG file");
+		data += YUV4MPEG_FRAME_HEADER_LEN;
+	}
+	else
+		data = file.read(FrameOffset(n), frame_sz);
 
-	auto src_y = reinterpret_cast<const unsigned char *>(file.read(seek_table[n], luma_sz + chroma_sz * 2));
+	auto src_y = reinterpret_cast<const unsigned char *>(data);
 	auto src_u = src_y + luma_sz;
 	auto src_v = src_u + chroma_sz;
+	int sample_sz = bit_depth > 8 ? 2 : 1;
+
+	// Returns a row of 8-bit samples, narrowing them into buf if needed
+	auto read_row = [&](const unsigned char *plane, int width, int row, uint8_t *buf) -> const uint8_t * {
+		auto src = plane + size_t(row) * width * sample_sz;
+		if (bit_depth == 8)
+			return src;
+		narrow_row(src, width, bit_depth, buf);
+		return buf;
+	};
+
+	std::vector<uint8_t> row_y(bit_depth > 8 ? w : 0);
+	std::vector<uint8_t> row_u(w, 128), row_v(w, 128);
+	std::vector<uint8_t> narrow_u(bit_depth > 8 ? chroma_w : 0), narrow_v(narrow_u.size());
+
 	frame.data.resize(w * h * 4);
 	unsigned char *dst = &frame.data[0];
 
+	int last_cy = -1;
 	for (int py = 0; py < h; ++py) {
-		for (int px = 0; px < w / 2; ++px) {
-			const uint8_t u = *src_u++;
-			const uint8_t v = *src_v++;
-			for (unsigned int i = 0; i < 2; ++i) {
-				const uint8_t y = *src_y++;
-				auto rgb = conv.ycbcr_to_rgb({{y, u, v}});
-				*dst++ = rgb[2];
-				*dst++ = rgb[1];
-				*dst++ = rgb[0];
-				*dst++ = 0;
+		auto y = read_row(src_y, w, py, row_y.data());
+		const uint8_t *u = row_u.data(), *v = row_v.data();
+
+		if (pixfmt != Y4M_PIXFMT_MONO) {
+			int cy = py >> chroma_shift_h;
+			auto cu = read_row(src_u, chroma_w, cy, narrow_u.data());
+			auto cv = read_row(src_v, chroma_w, cy, narrow_v.data());
+			if (!chroma_shift_w) {
+				u = cu;
+				v = cv;
+			}
+			else if (cy != last_cy) {
+				widen_row(cu, chroma_shift_w, w, row_u.data());
+				widen_row(cv, chroma_shift_w, w, row_v.data());
 			}
+			last_cy = cy;
 		}
 
-		// Roll back u/v on even lines
-		if (!(py & 1)) {
-			src_u -= uv_width;
-			src_v -= uv_width;
-		}
+		conv.ycbcr_to_bgra(y, u, v, w, dst + size_t(py) * w * 4);
 	}
 
 	frame.flipped = false;
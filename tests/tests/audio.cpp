@@ -16,6 +16,7 @@
 
 #include <main.h>
 
+#include <libaegisub/audio/envelope.h>
 #include <libaegisub/audio/provider.h>
 #include <libaegisub/fs.h>
 #include <libaegisub/make_unique.h>
@@ -228,6 +229,71 @@ TEST(lagi_audio, hd_cache) {
 		ASSERT_EQ(static_cast<uint16_t>((1 << 22) - 256 + i), buff[i]);
 }
 
+/// Test provider which can be read from several threads at once, and which
+/// doesn't return from any read until it's allowed to
+struct GatedAudioProvider : TestAudioProvider<> {
+	std::atomic<bool> *open;
+
+	GatedAudioProvider(std::atomic<bool> *open) : TestAudioProvider<>(300), open(open) { }
+
+	void FillBuffer(void *buf, int64_t start, int64_t count) const override {
+		while (!*open) agi::util::sleep_for(1);
+		TestAudioProvider<>::FillBuffer(buf, start, count);
+	}
+
+	bool SupportsConcurrentReads() const override { return true; }
+};
+
+TEST(lagi_audio, ram_cache_without_wait_returns_silence) {
+	std::atomic<bool> open{false};
+	auto provider = agi::CreateRAMAudioProvider(agi::make_unique<GatedAudioProvider>(&open));
+
+	uint16_t buff[512];
+	provider->GetAudio(buff, 10000000, 512);
+	for (size_t i = 0; i < 512; ++i)
+		ASSERT_EQ(0, buff[i]);
+
+	open = true;
+}
+
+TEST(lagi_audio, ram_cache_wait) {
+	std::atomic<bool> open{true};
+	auto provider = agi::CreateRAMAudioProvider(agi::make_unique<GatedAudioProvider>(&open), 60000);
+	EXPECT_TRUE(provider->SupportsConcurrentReads());
+
+	// Reads from anywhere in the file should get real samples straight away
+	uint16_t buff[512];
+	for (int64_t start : {10000000LL, (1LL << 22) - 256, 0LL, 300LL * 48000 - 512}) {
+		provider->GetAudio(buff, start, 512);
+		for (size_t i = 0; i < 512; ++i)
+			ASSERT_EQ(static_cast<uint16_t>(start + i), buff[i]);
+	}
+
+	while (provider->GetDecodedSamples() != provider->GetNumSamples()) agi::util::sleep_for(0);
+	std::vector<uint16_t> all(provider->GetNumSamples());
+	provider->GetAudio(all.data(), 0, all.size());
+	for (size_t i = 0; i < all.size(); ++i)
+		ASSERT_EQ(static_cast<uint16_t>(i), all[i]);
+}
+
+TEST(lagi_audio, hd_cache_wait) {
+	std::atomic<bool> open{true};
+	auto provider = agi::CreateHDAudioProvider(agi::make_unique<GatedAudioProvider>(&open), agi::Path().Decode("?temp"), 60000);
+
+	uint16_t buff[512];
+	for (int64_t start : {10000000LL, (1LL << 20) - 256, 0LL, 300LL * 48000 - 512}) {
+		provider->GetAudio(buff, start, 512);
+		for (size_t i = 0; i < 512; ++i)
+			ASSERT_EQ(static_cast<uint16_t>(start + i), buff[i]);
+	}
+
+	while (provider->GetDecodedSamples() != provider->GetNumSamples()) agi::util::sleep_for(0);
+	std::vector<uint16_t> all(provider->GetNumSamples());
+	provider->GetAudio(all.data(), 0, all.size());
+	for (size_t i = 0; i < all.size(); ++i)
+		ASSERT_EQ(static_cast<uint16_t>(i), all[i]);
+}
+
 TEST(lagi_audio, convert_8bit) {
 	auto provider = agi::CreateConvertAudioProvider(agi::make_unique<TestAudioProvider<uint8_t>>());
 
@@ -253,6 +319,49 @@ TEST(lagi_audio, convert_32bit) {
 	EXPECT_EQ(SHRT_MAX, sample);
 }
 
+TEST(lagi_audio, convert_24bit) {
+	struct AudioProvider : agi::AudioProvider {
+		AudioProvider() {
+			channels = 1;
+			num_samples = 1 << 24;
+			decoded_samples = num_samples;
+			sample_rate = 48000;
+			bytes_per_sample = 3;
+			float_samples = false;
+		}
+
+		void FillBuffer(void *buf, int64_t start, int64_t count) const override {
+			auto out = static_cast<uint8_t *>(buf);
+			for (int64_t end = start + count; start < end; ++start) {
+				*out++ = (uint8_t)start;
+				*out++ = (uint8_t)(start >> 8);
+				*out++ = (uint8_t)(start >> 16);
+			}
+		}
+	};
+
+	auto provider = agi::CreateConvertAudioProvider(agi::make_unique<AudioProvider>());
+	EXPECT_EQ(2, provider->GetBytesPerSample());
+
+	std::vector<int16_t> samples(100003);
+	for (int64_t start : {0LL, 12345LL, (1LL << 23) - 50000, (1LL << 24) - 100003}) {
+		provider->GetAudio(samples.data(), start, samples.size());
+		for (size_t i = 0; i < samples.size(); ++i)
+			ASSERT_EQ((int16_t)((start + i) >> 8), samples[i]);
+	}
+}
+
+TEST(lagi_audio, convert_32bit_bulk) {
+	auto src = agi::make_unique<TestAudioProvider<uint32_t>>(100000);
+	src->bias = INT_MIN;
+	auto provider = agi::CreateConvertAudioProvider(std::move(src));
+
+	std::vector<int16_t> samples(100003);
+	provider->GetAudio(samples.data(), (1LL << 31) - 50000, samples.size());
+	for (size_t i = 0; i < samples.size(); ++i)
+		ASSERT_EQ((int16_t)(((1LL << 31) - 50000 + i + INT_MIN) >> 16), samples[i]);
+}
+
 TEST(lagi_audio, sample_doubling) {
 	struct AudioProvider : agi::AudioProvider {
 		AudioProvider() {
@@ -318,6 +427,66 @@ TEST(lagi_audio, stereo_downmix) {
 		EXPECT_EQ(i, samples[i]);
 }
 
+TEST(lagi_audio, surround_downmix) {
+	struct AudioProvider : agi::AudioProvider {
+		AudioProvider() {
+			channels = 6;
+			num_samples = 90 * 48000;
+			decoded_samples = num_samples;
+			sample_rate = 48000;
+			bytes_per_sample = 2;
+			float_samples = false;
+		}
+
+		void FillBuffer(void *buf, int64_t start, int64_t count) const override {
+			auto out = static_cast<int16_t *>(buf);
+			for (int64_t end = start + count; start < end; ++start) {
+				for (int c = 0; c < channels; ++c)
+					*out++ = (int16_t)(start * (c + 1));
+			}
+		}
+	};
+
+	auto provider = agi::CreateConvertAudioProvider(agi::make_unique<AudioProvider>());
+	EXPECT_EQ(1, provider->GetChannels());
+
+	std::vector<int16_t> samples(20000);
+	provider->GetAudio(samples.data(), 1000, samples.size());
+	for (size_t i = 0; i < samples.size(); ++i) {
+		int sum = 0;
+		for (int c = 0; c < 6; ++c)
+			sum += (int16_t)((1000 + i) * (c + 1));
+		ASSERT_EQ(sum / 6, samples[i]);
+	}
+}
+
+TEST(lagi_audio, stereo_downmix_rounds_towards_zero) {
+	struct AudioProvider : agi::AudioProvider {
+		AudioProvider() {
+			channels = 2;
+			num_samples = 1 << 16;
+			decoded_samples = num_samples;
+			sample_rate = 48000;
+			bytes_per_sample = 2;
+			float_samples = false;
+		}
+
+		void FillBuffer(void *buf, int64_t start, int64_t count) const override {
+			auto out = static_cast<int16_t *>(buf);
+			for (int64_t end = start + count; start < end; ++start) {
+				*out++ = (int16_t)start;
+				*out++ = (int16_t)(start * 3);
+			}
+		}
+	};
+
+	auto provider = agi::CreateConvertAudioProvider(agi::make_unique<AudioProvider>());
+	std::vector<int16_t> samples(1 << 16);
+	provider->GetAudio(samples.data(), 0, samples.size());
+	for (size_t i = 0; i < samples.size(); ++i)
+		ASSERT_EQ(((int16_t)i + (int16_t)(i * 3)) / 2, samples[i]);
+}
+
 template<typename Float>
 struct FloatAudioProvider : agi::AudioProvider {
 	FloatAudioProvider() {
@@ -489,6 +658,34 @@ TEST(lagi_audio, multiple_data_chunks) {
 	agi::fs::Remove(path);
 }
 
+TEST(lagi_audio, many_data_chunks_random_access) {
+	auto path = agi::Path().Decode("?temp/many_data");
+
+	// Chunks of 1, 2, 3... samples, with each sample's value being its index
+	std::string file(RIFF FMT_VALID, sizeof(RIFF FMT_VALID) - 1);
+	uint16_t next = 0;
+	for (uint32_t len = 1; len <= 200; ++len) {
+		uint32_t size = len * 2;
+		file += "data";
+		file.append(reinterpret_cast<const char *>(&size), 4);
+		for (uint32_t i = 0; i < len; ++i, ++next)
+			file.append(reinterpret_cast<const char *>(&next), 2);
+	}
+	{ bfs::ofstream s(path); s.write(file.data(), file.size()); }
+
+	auto provider = agi::CreatePCMAudioProvider(path, nullptr);
+	ASSERT_EQ(next, provider->GetNumSamples());
+
+	std::vector<uint16_t> samples(500);
+	for (int64_t start = 0; start < next; start += 97) {
+		provider->GetAudio(samples.data(), start, samples.size());
+		for (size_t i = 0; i < samples.size(); ++i)
+			ASSERT_EQ(start + i < next ? start + i : 0, samples[i]);
+	}
+
+	agi::fs::Remove(path);
+}
+
 #define WAVE64_FILE \
 	"riff\x2e\x91\xcf\x11\xa5\xd6\x28\xdb\x04\xc1\x00\x00"   /* RIFF GUID */          \
 	"\x74\x00\0\0\0\0\0\0"                                   /* file size */          \
@@ -540,3 +737,93 @@ TEST(lagi_audio, wave64_truncated) {
 
 	agi::fs::Remove(path);
 }
+
+TEST(lagi_audio, envelope_matches_samples) {
+	TestAudioProvider<int16_t> provider(1);
+	agi::AudioEnvelope envelope(provider);
+	EXPECT_EQ(provider.GetNumSamples(), envelope.GetNumSamples());
+	EXPECT_EQ(provider.GetSampleRate(), envelope.GetSampleRate());
+
+	const int64_t ranges[][2] = {{0, 1}, {0, 256}, {100, 300}, {1000, 20000}, {30000, 48000}, {32700, 32800}};
+	for (auto const& range : ranges) {
+		int64_t start = range[0] / agi::AudioEnvelope::block_size * agi::AudioEnvelope::block_size;
+		int64_t end = std::min<int64_t>(48000,
+			(range[1] + agi::AudioEnvelope::block_size - 1) / agi::AudioEnvelope::block_size * agi::AudioEnvelope::block_size);
+
+		int16_t min = 32767, max = -32768;
+		double sum = 0;
+		for (int64_t i = start; i < end; ++i) {
+			auto sample = (int16_t)i;
+			min = std::min(min, sample);
+			max = std::max(max, sample);
+			sum += (double)sample * sample;
+		}
+
+		auto point = envelope.Summarise(range[0], range[1]);
+		EXPECT_EQ(min, point.min);
+		EXPECT_EQ(max, point.max);
+		EXPECT_NEAR(std::sqrt(sum / (end - start)), point.rms, 1e-6);
+	}
+
+	auto whole = envelope.Summarise(0, provider.GetNumSamples());
+	EXPECT_EQ(-32768, whole.min);
+	EXPECT_EQ(32767, whole.max);
+}
+
+TEST(lagi_audio, envelope_empty_range) {
+	TestAudioProvider<int16_t> provider(1);
+	agi::AudioEnvelope envelope(provider);
+	auto point = envelope.Summarise(50000, 60000);
+	EXPECT_EQ(0, point.min);
+	EXPECT_EQ(0, point.max);
+	EXPECT_EQ(0, point.rms);
+}
+
+TEST(lagi_audio, envelope_save_and_load) {
+	auto path = agi::Path().Decode("?temp/envelope");
+	TestAudioProvider<int16_t> provider(2);
+	agi::AudioEnvelope envelope(provider);
+	envelope.Save(path);
+
+	agi::AudioEnvelope loaded(path, provider);
+	for (int64_t start = 0; start < provider.GetNumSamples(); start += 12345) {
+		auto a = envelope.Summarise(start, start + 4800);
+		auto b = loaded.Summarise(start, start + 4800);
+		EXPECT_EQ(a.min, b.min);
+		EXPECT_EQ(a.max, b.max);
+		EXPECT_EQ(a.rms, b.rms);
+	}
+
+	TestAudioProvider<int16_t> other(3);
+	EXPECT_THROW(agi::AudioEnvelope(path, other), agi::AudioEnvelopeError);
+
+	{ bfs::ofstream s(path); s.write("garbage", 7); }
+	EXPECT_THROW(agi::AudioEnvelope(path, provider), agi::AudioEnvelopeError);
+
+	agi::fs::Remove(path);
+}
+
+TEST(lagi_audio, float_conversion_clamps) {
+	struct AudioProvider : agi::AudioProvider {
+		AudioProvider() {
+			channels = 1;
+			num_samples = 1000;
+			decoded_samples = num_samples;
+			sample_rate = 48000;
+			bytes_per_sample = sizeof(float);
+			float_samples = true;
+		}
+
+		void FillBuffer(void *buf, int64_t start, int64_t count) const override {
+			auto out = static_cast<float *>(buf);
+			for (int64_t end = start + count; start < end; ++start)
+				*out++ = (start & 1) ? 2.5f : -7.f;
+		}
+	};
+
+	auto provider = agi::CreateConvertAudioProvider(agi::make_unique<AudioProvider>());
+	int16_t samples[1000];
+	provider->GetAudio(samples, 0, 1000);
+	for (int i = 0; i < 1000; ++i)
+		ASSERT_EQ((i & 1) ? SHRT_MAX : SHRT_MIN, samples[i]);
+}
@@ -139,3 +139,12 @@ TEST(lagi_keyframe, aegi) {
 
 	EXPECT_TRUE(expected == res);
 }
+
+TEST(lagi_keyframe, wwxd) {
+	std::vector<int> expected = { 0, 25, 300 };
+
+	std::vector<int> res;
+	ASSERT_NO_THROW(res = Load("data/keyframe/wwxd.txt"));
+
+	EXPECT_TRUE(expected == res);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#include <main.h>
+
+#include <libaegisub/scene_detect.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace {
+const size_t width = 320, height = 180;
+
+/// Generate a frame of a synthetic video with cuts at 300, 600 and 800, a
+/// fade from 600 to 800 and motion and noise throughout
+std::vector<uint8_t> make_frame(int n) {
+	std::vector<uint8_t> frame(width * height);
+	uint32_t seed = n * 2654435761u;
+	for (size_t y = 0; y < height; ++y) {
+		for (size_t x = 0; x < width; ++x) {
+			int v;
+			if (n < 300)
+				v = 20 + int((x + n * 2) % width) * 200 / width;
+			else if (n < 600)
+				v = (((x + n) / 20 + y / 20) % 2) ? 200 : 50;
+			else if (n < 800)
+				v = 30 + (n - 600);
+			else
+				v = 240 - int(y + n - 800) % height;
+			seed = seed * 1664525 + 1013904223;
+			v += int(seed >> 29) - 4;
+			frame[y * width + x] = (uint8_t)std::max(0, std::min(255, v));
+		}
+	}
+	return frame;
+}
+}
+
+TEST(lagi_scene_detect, finds_cuts) {
+	agi::SceneDetector detector;
+	for (int n = 0; n < 900; ++n) {
+		auto frame = make_frame(n);
+		detector.AddFrame(frame.data(), width, height, width, 1);
+	}
+
+	std::vector<int> expected = {0, 300, 600, 800};
+	EXPECT_EQ(expected, detector.SceneChanges());
+	ASSERT_EQ(900u, detector.Differences().size());
+	EXPECT_EQ(0., detector.Differences()[0].luma);
+}
+
+TEST(lagi_scene_detect, bgra_and_flipped_match_gray) {
+	agi::SceneDetector gray, bgra, flipped;
+	for (int n = 250; n < 350; ++n) {
+		auto frame = make_frame(n);
+		gray.AddFrame(frame.data(), width, height, width, 1);
+
+		std::vector<uint8_t> rgb(frame.size() * 4);
+		for (size_t i = 0; i < frame.size(); ++i)
+			rgb[i * 4] = rgb[i * 4 + 1] = rgb[i * 4 + 2] = frame[i];
+		bgra.AddFrame(rgb.data(), width, height, width * 4, 4);
+
+		std::vector<uint8_t> upside_down(frame.size());
+		for (size_t y = 0; y < height; ++y)
+			std::copy_n(&frame[y * width], width, &upside_down[(height - y - 1) * width]);
+		flipped.AddFrame(&upside_down[(height - 1) * width], width, height, -(ptrdiff_t)width, 1);
+	}
+
+	auto const& expected = gray.Differences();
+	ASSERT_EQ(100u, expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		EXPECT_NEAR(expected[i].luma, bgra.Differences()[i].luma, 1e-9) << i;
+		EXPECT_NEAR(expected[i].histogram, bgra.Differences()[i].histogram, 1e-9) << i;
+		EXPECT_NEAR(expected[i].luma, flipped.Differences()[i].luma, 1e-9) << i;
+	}
+	EXPECT_EQ(std::vector<int>({0, 50}), gray.SceneChanges());
+}
+
+TEST(lagi_scene_detect, frame_size_must_not_change) {
+	agi::SceneDetector detector;
+	std::vector<uint8_t> frame(64 * 64);
+	detector.AddFrame(frame.data(), 64, 64, 64, 1);
+	EXPECT_THROW(detector.AddFrame(frame.data(), 32, 64, 32, 1), agi::SceneDetectorError);
+	EXPECT_TRUE(agi::SceneDetector().SceneChanges().empty());
+}
@@ -17,6 +17,7 @@
 #include <libaegisub/fs.h>
 #include <libaegisub/vfr.h>
 
+#include <algorithm>
 #include <climits>
 #include <fstream>
 #include <iterator>
@@ -354,6 +355,14 @@ TEST(lagi_vfr, load_v2_number_in_comment) {
 	}
 }
 
+TEST(lagi_vfr, load_v2_bom_crlf) {
+	Framerate fps;
+	ASSERT_NO_THROW(fps = Framerate("data/vfr/in/v2_bom_crlf.txt"));
+	for (int i = 0; i < 30; i++) {
+		EXPECT_EQ(i * 1000, fps.TimeAtFrame(i));
+	}
+}
+
 TEST(lagi_vfr, load_v1_save_v2) {
 	Framerate fps;
 	ASSERT_NO_THROW(fps = Framerate("data/vfr/in/v1_mode5.txt"));
@@ -767,3 +776,74 @@ TEST(lagi_vfr, from_smpte_ntsc_nodrop) {
 		++f;
 	}
 }
+
+TEST(lagi_vfr, compressed_timecodes_match_dense) {
+	// Runs of constant frame rate rounded in various ways, with duplicate
+	// frames and gaps between them
+	std::vector<int> timecodes;
+	double time = 0;
+	auto add_run = [&](double fps, int frames, bool round) {
+		for (int i = 0; i < frames; ++i, time += 1000. / fps)
+			timecodes.push_back(int(round ? time + .5 : time));
+	};
+	add_run(24000. / 1001., 500, false);
+	add_run(30000. / 1001., 333, true);
+	timecodes.push_back(timecodes.back());
+	time += 1000;
+	add_run(120., 1000, false);
+	add_run(59.94, 77, true);
+	add_run(1., 5, false);
+	add_run(1000., 20, false);
+	for (int i = 0; i < 200; ++i)
+		timecodes.push_back(timecodes.back() + 1 + (i * 7919) % 97);
+
+	Framerate fps(timecodes);
+	for (int frame = 0; frame < (int)timecodes.size(); ++frame)
+		ASSERT_EQ(timecodes[frame], fps.TimeAtFrame(frame)) << frame;
+	for (int frame = 1; frame + 1 < (int)timecodes.size(); ++frame) {
+		int prev = timecodes[frame - 1], cur = timecodes[frame], next = timecodes[frame + 1];
+		ASSERT_EQ(prev + (cur - prev + 1) / 2, fps.TimeAtFrame(frame, START)) << frame;
+		ASSERT_EQ(cur + (next - cur + 1) / 2, fps.TimeAtFrame(frame, END)) << frame;
+	}
+
+	for (int ms = 0; ms <= timecodes.back(); ++ms) {
+		int expected = (int)(std::upper_bound(timecodes.begin(), timecodes.end(), ms) - timecodes.begin()) - 1;
+		ASSERT_EQ(expected, fps.FrameAtTime(ms)) << ms;
+	}
+}
+
+TEST(lagi_vfr, batch_conversion_matches_single) {
+	std::vector<int> timecodes;
+	for (int i = 0; i < 100; ++i)
+		timecodes.push_back(i * 1001 / 24);
+	for (int i = 1; i <= 100; ++i)
+		timecodes.push_back(timecodes[99] + i * 1001 / 60);
+	for (int i = 1; i <= 100; ++i)
+		timecodes.push_back(timecodes[199] + i * 1001 / 30);
+	Framerate fps(timecodes);
+
+	// Sorted, then shuffled with repeats and values outside the timecodes
+	std::vector<int> values;
+	for (int i = -50; i < 6000; i += 7)
+		values.push_back(i);
+	std::vector<int> shuffled;
+	for (size_t i = 0; i < values.size(); ++i)
+		shuffled.push_back(values[i * 7919 % values.size()]);
+	shuffled.push_back(shuffled.front());
+
+	for (auto const& in : {values, shuffled}) {
+		for (auto type : {EXACT, START, END}) {
+			std::vector<int> frames(in.size()), times(in.size());
+			fps.FramesAtTimes(in.data(), in.size(), frames.data(), type);
+			fps.TimesAtFrames(in.data(), in.size(), times.data(), type);
+			for (size_t i = 0; i < in.size(); ++i) {
+				ASSERT_EQ(fps.FrameAtTime(in[i], type), frames[i]) << in[i];
+				ASSERT_EQ(fps.TimeAtFrame(in[i], type), times[i]) << in[i];
+			}
+
+			auto inplace = in;
+			fps.FramesAtTimes(inplace.data(), inplace.size(), inplace.data(), type);
+			EXPECT_EQ(frames, inplace);
+		}
+	}
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2026, Aegisub contributors
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Aegisub Project http://www.aegisub.org/
+
+#include <libaegisub/ycbcr_conv.h>
+
+#include <main.h>
+
+#include <cstdlib>
+#include <vector>
+
+class lagi_ycbcr : public libagi { };
+
+using namespace agi;
+
+TEST(lagi_ycbcr, bulk_matches_single) {
+	// 37 pixels so that both the vectorised loop and the tail are used
+	const size_t count = 37;
+	std::vector<uint8_t> bgra(count * 4);
+	for (size_t i = 0; i < bgra.size(); ++i)
+		bgra[i] = static_cast<uint8_t>(i * 97 + 13);
+	bgra[0] = bgra[1] = bgra[2] = 0;
+	bgra[4] = bgra[5] = bgra[6] = 255;
+
+	for (auto range : {ycbcr_range::tv, ycbcr_range::pc}) {
+		ycbcr_converter conv(ycbcr_matrix::bt709, range);
+		std::vector<uint8_t> y(count), cb(count), cr(count);
+		conv.bgra_to_ycbcr(bgra.data(), count, y.data(), cb.data(), cr.data());
+
+		for (size_t i = 0; i < count; ++i) {
+			auto expected = conv.rgb_to_ycbcr({{bgra[i * 4 + 2], bgra[i * 4 + 1], bgra[i * 4]}});
+			EXPECT_GE(1, std::abs(expected[0] - y[i]));
+			EXPECT_GE(1, std::abs(expected[1] - cb[i]));
+			EXPECT_GE(1, std::abs(expected[2] - cr[i]));
+		}
+	}
+}
+
+TEST(lagi_ycbcr, bulk_black_and_white) {
+	uint8_t bgra[] = {0, 0, 0, 0, 255, 255, 255, 0};
+	uint8_t y[2], cb[2], cr[2];
+
+	ycbcr_converter(ycbcr_matrix::bt601, ycbcr_range::tv).bgra_to_ycbcr(bgra, 2, y, cb, cr);
+	EXPECT_EQ(16, y[0]);
+	EXPECT_EQ(235, y[1]);
+	EXPECT_EQ(128, cb[0]);
+	EXPECT_EQ(128, cr[1]);
+
+	ycbcr_converter(ycbcr_matrix::bt601, ycbcr_range::pc).bgra_to_ycbcr(bgra, 2, y, cb, cr);
+	EXPECT_EQ(0, y[0]);
+	EXPECT_EQ(255, y[1]);
+}
+
+TEST(lagi_ycbcr, bulk_to_bgra_matches_single) {
+	const size_t count = 37;
+	std::vector<uint8_t> y(count), cb(count), cr(count);
+	for (size_t i = 0; i < count; ++i) {
+		y[i] = static_cast<uint8_t>(i * 97 + 13);
+		cb[i] = static_cast<uint8_t>(i * 59 + 7);
+		cr[i] = static_cast<uint8_t>(i * 31 + 101);
+	}
+	y[0] = cb[0] = cr[0] = 0;
+	y[1] = cb[1] = cr[1] = 255;
+
+	for (auto matrix : {ycbcr_matrix::bt601, ycbcr_matrix::bt709}) {
+		for (auto range : {ycbcr_range::tv, ycbcr_range::pc}) {
+			ycbcr_converter conv(matrix, range);
+			std::vector<uint8_t> bgra(count * 4, 1);
+			conv.ycbcr_to_bgra(y.data(), cb.data(), cr.data(), count, bgra.data());
+
+			for (size_t i = 0; i < count; ++i) {
+				auto expected = conv.ycbcr_to_rgb({{y[i], cb[i], cr[i]}});
+				EXPECT_GE(1, std::abs(expected[2] - bgra[i * 4]));
+				EXPECT_GE(1, std::abs(expected[1] - bgra[i * 4 + 1]));
+				EXPECT_GE(1, std::abs(expected[0] - bgra[i * 4 + 2]));
+				EXPECT_EQ(0, bgra[i * 4 + 3]);
+			}
+		}
+	}
+}
+
+TEST(lagi_ycbcr, bulk_to_bgra_black_and_white) {
+	uint8_t y[] = {16, 235}, c[] = {128, 128};
+	uint8_t bgra[8];
+
+	ycbcr_converter(ycbcr_matrix::bt601, ycbcr_range::tv).ycbcr_to_bgra(y, c, c, 2, bgra);
+	for (int i = 0; i < 3; ++i) {
+		EXPECT_EQ(0, bgra[i]);
+		EXPECT_EQ(255, bgra[4 + i]);
+	}
+}